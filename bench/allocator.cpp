@@ -1,7 +1,10 @@
 #include <benchmark/benchmark.h>
 #include "fst/allocator.h"
+#include "fst/memory_resource.h"
 #include "fst/print.h"
 #include <array>
+#include <map>
+#include <memory_resource>
 #include <vector>
 #include <string>
 
@@ -70,3 +73,80 @@ static void fst_bench_alloc_std_array_loop(benchmark::State& state) {
   benchmark::DoNotOptimize(k);
 }
 BENCHMARK(fst_bench_alloc_std_array_loop);
+
+inline constexpr std::size_t pmr_loop_size = 1024;
+
+template <typename Vector>
+inline void fill_vector(Vector& buffer) {
+  for (std::size_t i = 0; i < pmr_loop_size; i++) {
+    buffer.push_back((int)i);
+  }
+}
+
+template <typename Map>
+inline void fill_map(Map& map) {
+  for (std::size_t i = 0; i < pmr_loop_size / 4; i++) {
+    map[(int)i] = (int)i * 2;
+  }
+}
+
+static void fst_bench_pmr_pool_vector(benchmark::State& state) {
+  for (auto _ : state) {
+    fst::pmr_resource<pool_allocator_type> resource;
+    std::pmr::vector<int> buffer(&resource);
+    fill_vector(buffer);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+}
+BENCHMARK(fst_bench_pmr_pool_vector);
+
+static void fst_bench_pmr_monotonic_vector(benchmark::State& state) {
+  for (auto _ : state) {
+    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::vector<int> buffer(&resource);
+    fill_vector(buffer);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+}
+BENCHMARK(fst_bench_pmr_monotonic_vector);
+
+static void fst_bench_pmr_fst_pool_vector(benchmark::State& state) {
+  for (auto _ : state) {
+    pool_allocator_type pool;
+    std::vector<int, allocator_type> buffer((pool));
+    fill_vector(buffer);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+}
+BENCHMARK(fst_bench_pmr_fst_pool_vector);
+
+static void fst_bench_pmr_fst_monotonic_vector(benchmark::State& state) {
+  for (auto _ : state) {
+    std::pmr::monotonic_buffer_resource resource;
+    std::vector<int, fst::allocator<int, fst::memory_resource_allocator>> buffer(
+        (fst::memory_resource_allocator(&resource)));
+    fill_vector(buffer);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+}
+BENCHMARK(fst_bench_pmr_fst_monotonic_vector);
+
+static void fst_bench_pmr_pool_map(benchmark::State& state) {
+  for (auto _ : state) {
+    fst::pmr_resource<pool_allocator_type> resource;
+    std::pmr::map<int, int> map(&resource);
+    fill_map(map);
+    benchmark::DoNotOptimize(map.size());
+  }
+}
+BENCHMARK(fst_bench_pmr_pool_map);
+
+static void fst_bench_pmr_monotonic_map(benchmark::State& state) {
+  for (auto _ : state) {
+    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::map<int, int> map(&resource);
+    fill_map(map);
+    benchmark::DoNotOptimize(map.size());
+  }
+}
+BENCHMARK(fst_bench_pmr_monotonic_map);
@@ -0,0 +1,333 @@
+#include <benchmark/benchmark.h>
+#include "fst/allocator.h"
+#include <condition_variable>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Allocator workloads.
+// Every benchmark runs against glibc malloc (std::allocator or std::malloc), fst::crt_allocator and the fst pools.
+// The pool benchmarks take the chunk size as last argument.
+
+namespace {
+inline constexpr std::size_t default_chunk_size = 64 * 1024;
+
+using pool_allocator_type = fst::memory_pool_allocator<>;
+using size_class_allocator_type = fst::size_class_pool_allocator<>;
+using concurrent_allocator_type = fst::concurrent_memory_pool_allocator<>;
+
+/// Raw block interface over the different allocators.
+struct malloc_blocks {
+  malloc_blocks(std::size_t) {}
+  inline void* allocate(std::size_t size) { return std::malloc(size); }
+  inline void free(void* ptr, std::size_t) { std::free(ptr); }
+};
+
+template <typename _Allocator>
+struct fst_blocks {
+  fst_blocks(std::size_t chunk_size)
+      : allocator(make_allocator(chunk_size)) {}
+
+  static inline _Allocator make_allocator(std::size_t chunk_size) {
+    if constexpr (std::is_same_v<_Allocator, fst::crt_allocator>) {
+      fst::unused(chunk_size);
+      return _Allocator();
+    }
+    else {
+      return _Allocator(chunk_size);
+    }
+  }
+
+  inline void* allocate(std::size_t size) { return allocator.allocate(size); }
+  inline void free(void* ptr, std::size_t size) { static_cast<void>(allocator.realloc(ptr, size, 0)); }
+
+  _Allocator allocator;
+};
+
+using crt_blocks = fst_blocks<fst::crt_allocator>;
+using pool_blocks = fst_blocks<pool_allocator_type>;
+using size_class_blocks = fst_blocks<size_class_allocator_type>;
+using concurrent_blocks = fst_blocks<concurrent_allocator_type>;
+
+inline std::size_t get_chunk_size(const benchmark::State& state, std::size_t index) {
+  return state.range(index) ? (std::size_t)state.range(index) : default_chunk_size;
+}
+
+//
+// Vector growth.
+//
+template <typename _Vector>
+inline void grow_vector(_Vector& buffer, std::size_t size) {
+  for (std::size_t i = 0; i < size; i++) {
+    buffer.push_back((int)i);
+  }
+  benchmark::DoNotOptimize(buffer.data());
+}
+
+static void fst_bench_workload_vector_growth_std(benchmark::State& state) {
+  for (auto _ : state) {
+    std::vector<int> buffer;
+    grow_vector(buffer, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_vector_growth_std)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+static void fst_bench_workload_vector_growth_crt(benchmark::State& state) {
+  for (auto _ : state) {
+    std::vector<int, fst::allocator<int>> buffer;
+    grow_vector(buffer, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_vector_growth_crt)->RangeMultiplier(32)->Range(1 << 10, 1 << 20);
+
+static void fst_bench_workload_vector_growth_pool(benchmark::State& state) {
+  for (auto _ : state) {
+    pool_allocator_type pool(get_chunk_size(state, 1));
+    std::vector<int, fst::allocator<int, pool_allocator_type>> buffer((pool));
+    grow_vector(buffer, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_vector_growth_pool)
+    ->ArgsProduct({ benchmark::CreateRange(1 << 10, 1 << 20, 32), { 4 << 10, 64 << 10, 1 << 20 } });
+
+static void fst_bench_workload_vector_growth_size_class(benchmark::State& state) {
+  for (auto _ : state) {
+    size_class_allocator_type pool(get_chunk_size(state, 1));
+    std::vector<int, fst::allocator<int, size_class_allocator_type>> buffer((pool));
+    grow_vector(buffer, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_vector_growth_size_class)
+    ->ArgsProduct({ benchmark::CreateRange(1 << 10, 1 << 20, 32), { 4 << 10, 64 << 10, 1 << 20 } });
+
+//
+// Mixed small/large allocation trace.
+// 90% of the blocks are between 8 and 256 bytes, the others between 1k and 64k.
+// Half of the live blocks are freed in random order every 1024 allocations.
+//
+struct trace_entry {
+  std::size_t size;
+  std::size_t free_index;
+};
+
+inline const std::vector<trace_entry>& get_mixed_trace() {
+  static const std::vector<trace_entry> trace = []() {
+    constexpr std::size_t trace_size = 64 * 1024;
+    std::mt19937 gen(32);
+    std::uniform_int_distribution<std::size_t> kind(0, 9);
+    std::uniform_int_distribution<std::size_t> small_size(8, 256);
+    std::uniform_int_distribution<std::size_t> large_size(1024, 64 * 1024);
+
+    std::vector<trace_entry> t(trace_size);
+    for (std::size_t i = 0; i < trace_size; i++) {
+      t[i].size = kind(gen) ? small_size(gen) : large_size(gen);
+      t[i].free_index = std::uniform_int_distribution<std::size_t>(0, i)(gen);
+    }
+    return t;
+  }();
+
+  return trace;
+}
+
+template <typename _Blocks>
+static void fst_bench_workload_mixed_trace(benchmark::State& state) {
+  const std::vector<trace_entry>& trace = get_mixed_trace();
+  std::vector<std::pair<void*, std::size_t>> live;
+  live.reserve(trace.size());
+
+  for (auto _ : state) {
+    _Blocks blocks(get_chunk_size(state, 0));
+    live.clear();
+
+    for (std::size_t i = 0; i < trace.size(); i++) {
+      live.emplace_back(blocks.allocate(trace[i].size), trace[i].size);
+
+      if ((i & 1023) == 1023) {
+        for (std::size_t k = 0; k < live.size() / 2; k++) {
+          std::swap(live[trace[i - k].free_index % live.size()], live.back());
+          blocks.free(live.back().first, live.back().second);
+          live.pop_back();
+        }
+      }
+    }
+
+    for (const auto& block : live) {
+      blocks.free(block.first, block.second);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * trace.size());
+}
+BENCHMARK_TEMPLATE(fst_bench_workload_mixed_trace, malloc_blocks)->Arg(0);
+BENCHMARK_TEMPLATE(fst_bench_workload_mixed_trace, crt_blocks)->Arg(0);
+BENCHMARK_TEMPLATE(fst_bench_workload_mixed_trace, pool_blocks)->Arg(64 << 10)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK_TEMPLATE(fst_bench_workload_mixed_trace, size_class_blocks)->Arg(64 << 10)->Arg(1 << 20);
+
+//
+// Map with node churn.
+// Inserts range(0) nodes, then repeatedly erases and reinserts a quarter of them.
+//
+template <typename _Map>
+inline void map_churn(_Map& map, std::size_t size) {
+  for (std::size_t i = 0; i < size; i++) {
+    map[(int)i] = (int)i;
+  }
+
+  for (std::size_t k = 0; k < 8; k++) {
+    for (std::size_t i = k % 4; i < size; i += 4) {
+      map.erase((int)i);
+    }
+
+    for (std::size_t i = k % 4; i < size; i += 4) {
+      map[(int)i] = (int)(i + k);
+    }
+  }
+
+  benchmark::DoNotOptimize(map.size());
+}
+
+template <typename _Allocator>
+using churn_map = std::map<int, int, std::less<int>, fst::allocator<std::pair<const int, int>, _Allocator>>;
+
+static void fst_bench_workload_map_churn_std(benchmark::State& state) {
+  for (auto _ : state) {
+    std::map<int, int> map;
+    map_churn(map, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_map_churn_std)->Arg(1 << 10)->Arg(1 << 16);
+
+static void fst_bench_workload_map_churn_crt(benchmark::State& state) {
+  for (auto _ : state) {
+    churn_map<fst::crt_allocator> map;
+    map_churn(map, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_map_churn_crt)->Arg(1 << 10)->Arg(1 << 16);
+
+static void fst_bench_workload_map_churn_pool(benchmark::State& state) {
+  for (auto _ : state) {
+    pool_allocator_type pool(get_chunk_size(state, 1));
+    churn_map<pool_allocator_type> map((pool));
+    map_churn(map, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_map_churn_pool)->ArgsProduct({ { 1 << 10, 1 << 16 }, { 4 << 10, 64 << 10, 1 << 20 } });
+
+static void fst_bench_workload_map_churn_size_class(benchmark::State& state) {
+  for (auto _ : state) {
+    size_class_allocator_type pool(get_chunk_size(state, 1));
+    churn_map<size_class_allocator_type> map((pool));
+    map_churn(map, state.range(0));
+  }
+}
+BENCHMARK(fst_bench_workload_map_churn_size_class)
+    ->ArgsProduct({ { 1 << 10, 1 << 16 }, { 4 << 10, 64 << 10, 1 << 20 } });
+
+//
+// Multi-threaded producer/consumer.
+// range(0) producers allocate batches of blocks and hand them to as many consumers that free them.
+//
+class block_queue {
+public:
+  using batch_type = std::vector<std::pair<void*, std::size_t>>;
+
+  inline void push(batch_type&& batch) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _batches.push_back(std::move(batch));
+    }
+    _cv.notify_one();
+  }
+
+  inline void close() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _closed = true;
+    }
+    _cv.notify_all();
+  }
+
+  /// Returns false once the queue is closed and empty.
+  inline bool pop(batch_type& batch) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [this]() { return _closed || !_batches.empty(); });
+
+    if (_batches.empty()) {
+      return false;
+    }
+
+    batch = std::move(_batches.back());
+    _batches.pop_back();
+    return true;
+  }
+
+private:
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::vector<batch_type> _batches;
+  bool _closed = false;
+};
+
+template <typename _Blocks>
+static void fst_bench_workload_producer_consumer(benchmark::State& state) {
+  constexpr std::size_t batch_count = 64;
+  constexpr std::size_t batch_size = 256;
+  const std::size_t thread_count = (std::size_t)state.range(0);
+
+  for (auto _ : state) {
+    _Blocks blocks(get_chunk_size(state, 1));
+    block_queue queue;
+
+    std::vector<std::thread> producers;
+    std::vector<std::thread> consumers;
+
+    for (std::size_t t = 0; t < thread_count; t++) {
+      producers.emplace_back([&blocks, &queue, t]() {
+        for (std::size_t b = 0; b < batch_count; b++) {
+          block_queue::batch_type batch;
+          batch.reserve(batch_size);
+
+          for (std::size_t i = 0; i < batch_size; i++) {
+            const std::size_t size = 16 + ((t + b + i) % 16) * 16;
+            batch.emplace_back(blocks.allocate(size), size);
+          }
+
+          queue.push(std::move(batch));
+        }
+      });
+
+      consumers.emplace_back([&blocks, &queue]() {
+        block_queue::batch_type batch;
+        while (queue.pop(batch)) {
+          for (const auto& block : batch) {
+            blocks.free(block.first, block.second);
+          }
+        }
+      });
+    }
+
+    for (std::thread& t : producers) {
+      t.join();
+    }
+
+    queue.close();
+
+    for (std::thread& t : consumers) {
+      t.join();
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * thread_count * batch_count * batch_size);
+}
+BENCHMARK_TEMPLATE(fst_bench_workload_producer_consumer, malloc_blocks)
+    ->ArgsProduct({ { 1, 4, 8 }, { 0 } })
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(fst_bench_workload_producer_consumer, crt_blocks)->ArgsProduct({ { 1, 4, 8 }, { 0 } })->UseRealTime();
+BENCHMARK_TEMPLATE(fst_bench_workload_producer_consumer, concurrent_blocks)
+    ->ArgsProduct({ { 1, 4, 8 }, { 64 << 10, 1 << 20 } })
+    ->UseRealTime();
+} // namespace
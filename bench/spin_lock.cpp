@@ -0,0 +1,90 @@
+#include <benchmark/benchmark.h>
+#include "fst/spin_lock.h"
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+// Lock contention.
+// Every thread increments a shared counter range(0) times per critical section.
+
+namespace {
+/// The previous spin_lock_mutex, busy-waiting on test_and_set.
+class busy_spin_lock {
+public:
+  inline void lock() noexcept {
+    while (_flag.test_and_set(std::memory_order_acquire))
+      ;
+  }
+
+  inline void unlock() noexcept { _flag.clear(std::memory_order_release); }
+
+private:
+  std::atomic_flag _flag = ATOMIC_FLAG_INIT;
+};
+
+template <typename _Mutex>
+static void fst_bench_lock_contention(benchmark::State& state) {
+  static _Mutex mutex;
+  static std::size_t counter = 0;
+  const std::size_t work = (std::size_t)state.range(0);
+
+  for (auto _ : state) {
+    std::lock_guard<_Mutex> lock(mutex);
+    for (std::size_t i = 0; i < work; i++) {
+      benchmark::DoNotOptimize(++counter);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(fst_bench_lock_contention, busy_spin_lock)->Arg(1)->Arg(64)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(fst_bench_lock_contention, fst::spin_lock_mutex)->Arg(1)->Arg(64)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(fst_bench_lock_contention, fst::ticket_spin_lock)->Arg(1)->Arg(64)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(fst_bench_lock_contention, std::mutex)->Arg(1)->Arg(64)->ThreadRange(1, 16)->UseRealTime();
+
+// Read-mostly.
+// One access out of range(0) is a write, the others read a small shared table.
+
+template <typename _Mutex>
+struct shared_lock_traits {
+  static inline void lock_shared(_Mutex& mutex) { mutex.lock_shared(); }
+  static inline void unlock_shared(_Mutex& mutex) { mutex.unlock_shared(); }
+};
+
+template <>
+struct shared_lock_traits<fst::spin_lock_mutex> {
+  static inline void lock_shared(fst::spin_lock_mutex& mutex) { mutex.lock(); }
+  static inline void unlock_shared(fst::spin_lock_mutex& mutex) { mutex.unlock(); }
+};
+
+template <typename _Mutex>
+static void fst_bench_lock_read_mostly(benchmark::State& state) {
+  static _Mutex mutex;
+  static std::size_t table[16] = {};
+  const std::size_t write_period = (std::size_t)state.range(0);
+  std::size_t i = (std::size_t)state.thread_index();
+
+  for (auto _ : state) {
+    if (++i % write_period == 0) {
+      std::lock_guard<_Mutex> lock(mutex);
+      table[i % 16]++;
+    }
+    else {
+      shared_lock_traits<_Mutex>::lock_shared(mutex);
+      std::size_t sum = 0;
+      for (std::size_t v : table) {
+        sum += v;
+      }
+      benchmark::DoNotOptimize(sum);
+      shared_lock_traits<_Mutex>::unlock_shared(mutex);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(fst_bench_lock_read_mostly, fst::spin_lock_mutex)->Arg(16)->Arg(1024)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(fst_bench_lock_read_mostly, fst::shared_spin_lock)->Arg(16)->Arg(1024)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(fst_bench_lock_read_mostly, std::shared_mutex)->Arg(16)->Arg(1024)->ThreadRange(1, 16)->UseRealTime();
+} // namespace
@@ -37,8 +37,23 @@
 #include <fst/memory>
 #include <fst/traits>
 #include <fst/pointer>
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <cstring>
 
+// clang-format off
+#if __FST_LINUX__
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+
+  #if __has_include(<linux/mempolicy.h>)
+    #include <linux/mempolicy.h>
+  #endif
+#endif
+// clang-format on
+
 // https://github.com/Tencent/rapidjson/blob/master/include/rapidjson/allocators.h
 namespace fst {
 
@@ -50,12 +65,108 @@ public:
   static constexpr bool is_ref_counted = _RefCounted;
 };
 
+/// Snapshot of the counters of an allocator using the allocator_stats_counter policy.
+struct allocator_stats {
+  /// Number of allocated memory blocks (reallocations that move a block included).
+  std::size_t allocation_count = 0;
+  /// Number of deallocated memory blocks.
+  std::size_t deallocation_count = 0;
+  /// Number of memory chunks.
+  std::size_t chunk_count = 0;
+  /// Bytes currently allocated, alignment padding included.
+  std::size_t size = 0;
+  /// Highest value reached by size.
+  std::size_t peak_size = 0;
+  /// Total capacity of the memory chunks in bytes.
+  std::size_t capacity = 0;
+  /// Bytes lost to alignment padding.
+  std::size_t alignment_waste = 0;
+};
+
+/// Default stats policy of the allocators, keeps nothing.
+struct no_allocator_stats {
+  static constexpr bool enabled = false;
+
+  inline void add_allocation(std::size_t, std::size_t) noexcept {}
+  inline void add_deallocation(std::size_t) noexcept {}
+  inline void add_size(std::size_t) noexcept {}
+  inline void remove_size(std::size_t) noexcept {}
+  inline void add_chunk(std::size_t) noexcept {}
+  inline void remove_chunk(std::size_t) noexcept {}
+};
+
+/// Stats policy with O(1) counters.
+/// The counters are not atomic, they are updated by the allocator that owns them.
+class allocator_stats_counter {
+public:
+  static constexpr bool enabled = true;
+
+  /// @param requested_size The size asked by the user.
+  /// @param size The size actually used, including alignment padding.
+  inline void add_allocation(std::size_t requested_size, std::size_t size) noexcept {
+    _stats.allocation_count++;
+    _stats.alignment_waste += size - requested_size;
+    add_size(size);
+  }
+
+  inline void add_deallocation(std::size_t size) noexcept {
+    _stats.deallocation_count++;
+    remove_size(size);
+  }
+
+  inline void add_size(std::size_t size) noexcept {
+    _stats.size += size;
+    _stats.peak_size = std::max(_stats.peak_size, _stats.size);
+  }
+
+  inline void remove_size(std::size_t size) noexcept {
+    fst_noexcept_assert(_stats.size >= size, "");
+    _stats.size -= size;
+  }
+
+  inline void add_chunk(std::size_t capacity) noexcept {
+    _stats.chunk_count++;
+    _stats.capacity += capacity;
+  }
+
+  inline void remove_chunk(std::size_t capacity) noexcept {
+    fst_noexcept_assert(_stats.chunk_count > 0 && _stats.capacity >= capacity, "");
+    _stats.chunk_count--;
+    _stats.capacity -= capacity;
+  }
+
+  /// Restarts the high-water mark from the current size.
+  inline void reset_peak_size() noexcept { _stats.peak_size = _stats.size; }
+
+  inline const allocator_stats& get_stats() const noexcept { return _stats; }
+
+private:
+  allocator_stats _stats;
+};
+
 /// Runtime library allocator.
 /// This class is just wrapper for standard C library memory routines.
 class crt_allocator : public internal_allocator_base<crt_allocator, true, false> {
 public:
+  /// Alignment of the memory blocks returned by allocate(size).
+  static constexpr std::size_t default_alignment = alignof(std::max_align_t);
+
   inline void* allocate(std::size_t size) { return size ? fst::memory::malloc(size) : nullptr; }
 
+#if __FST_UNISTD__
+  /// Allocates a memory block aligned on alignment, which must be a power of two.
+  /// The block is deallocated with free().
+  inline void* allocate(std::size_t size, std::size_t alignment) {
+    fst_noexcept_assert(fst::math::is_power_of_two(alignment), "alignment must be a power of two.");
+    if (alignment <= default_alignment) {
+      return allocate(size);
+    }
+
+    void* ptr = nullptr;
+    return size && ::posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+  }
+#endif // __FST_UNISTD__
+
   inline void* realloc(void* original_ptr, std::size_t original_size, std::size_t new_size) {
     fst::unused(original_size);
 
@@ -73,6 +184,135 @@ public:
   inline bool operator!=(const crt_allocator&) const noexcept { return false; }
 };
 
+#if __FST_LINUX__
+/// Linux huge page allocator.
+/// Large blocks are mapped with mmap, aligned on huge_page_size and advised with MADV_HUGEPAGE
+/// so that transparent huge pages can back them. When NumaNode is not negative, the pages of
+/// large blocks are bound to that NUMA node (MPOL_PREFERRED) before being touched.
+/// Blocks smaller than half a huge page can't fill one and are served by malloc.
+///
+/// Meant to be used as the BaseAllocator of the memory pools, their default chunk size then
+/// matches preferred_chunk_size.
+/// @tparam NumaNode the preferred NUMA node or -1 to keep the default policy.
+template <int NumaNode = -1>
+class huge_page_allocator : public internal_allocator_base<huge_page_allocator<NumaNode>, true, false> {
+  static_assert(NumaNode >= -1 && NumaNode < (int)(sizeof(unsigned long) * CHAR_BIT), "Invalid NUMA node.");
+
+  /// Stored right before each block.
+  struct block_header {
+    /// Start of the mmap region or the pointer returned by malloc.
+    void* data;
+    /// Size of the mmap region, zero when allocated with malloc.
+    std::size_t mapping_size;
+  };
+
+  static constexpr std::size_t header_size = fst::memory::aligned_size<16, block_header>();
+
+public:
+  /// Alignment of the memory blocks returned by allocate(size).
+  static constexpr std::size_t default_alignment = header_size;
+  static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+  static constexpr std::size_t preferred_chunk_size = huge_page_size;
+  static constexpr std::size_t small_size_threshold = huge_page_size / 2;
+  static constexpr int numa_node = NumaNode;
+
+  inline void* allocate(std::size_t size) {
+    if (!size) {
+      return nullptr;
+    }
+
+    if (size < small_size_threshold) {
+      void* data = fst::memory::malloc(header_size + size);
+      if (!data) {
+        return nullptr;
+      }
+
+      ::new (data) block_header{ data, 0 };
+      return static_cast<std::uint8_t*>(data) + header_size;
+    }
+
+    // Maps one more huge page to align the block, the header goes in the page right before it.
+    size = fst::memory::aligned_size<huge_page_size>(size);
+    std::size_t mapping_size = size + huge_page_size;
+    void* mapping = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapping == MAP_FAILED) {
+      return nullptr;
+    }
+
+    const std::uintptr_t page_size = fst::memory::get_page_size();
+    const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(mapping);
+    const std::uintptr_t aligned = (start + header_size + huge_page_size - 1) & ~(huge_page_size - 1);
+    const std::uintptr_t end = start + mapping_size;
+
+    // Unmaps the unused head and tail.
+    const std::uintptr_t new_start = aligned - page_size;
+    if (new_start > start) {
+      ::munmap(mapping, new_start - start);
+    }
+
+    if (end > aligned + size) {
+      ::munmap(reinterpret_cast<void*>(aligned + size), end - (aligned + size));
+    }
+
+    std::uint8_t* data = reinterpret_cast<std::uint8_t*>(aligned);
+
+    // Fails silently when transparent huge pages are disabled.
+    ::madvise(data, size, MADV_HUGEPAGE);
+
+    if constexpr (NumaNode >= 0) {
+      bind_to_node(data, size);
+    }
+
+    ::new (data - header_size) block_header{ reinterpret_cast<void*>(new_start), aligned + size - new_start };
+    return data;
+  }
+
+  inline void* realloc(void* original_ptr, std::size_t original_size, std::size_t new_size) {
+    if (new_size == 0) {
+      free(original_ptr);
+      return nullptr;
+    }
+
+    void* ptr = allocate(new_size);
+    if (ptr && original_ptr) {
+      std::memcpy(ptr, original_ptr, std::min(original_size, new_size));
+      free(original_ptr);
+    }
+
+    return ptr;
+  }
+
+  inline static void free(void* ptr) noexcept {
+    if (!ptr) {
+      return;
+    }
+
+    const block_header* header = reinterpret_cast<const block_header*>(static_cast<std::uint8_t*>(ptr) - header_size);
+    if (header->mapping_size) {
+      ::munmap(header->data, header->mapping_size);
+    }
+    else {
+      fst::memory::free(header->data);
+    }
+  }
+
+  inline bool operator==(const huge_page_allocator&) const noexcept { return true; }
+  inline bool operator!=(const huge_page_allocator&) const noexcept { return false; }
+
+private:
+  static inline void bind_to_node(void* data, std::size_t size) noexcept {
+#if defined(SYS_mbind) && defined(MPOL_PREFERRED)
+    unsigned long node_mask = 1UL << NumaNode;
+    // The kernel reads maxnode - 1 bits of the mask.
+    ::syscall(SYS_mbind, data, size, MPOL_PREFERRED, &node_mask, sizeof(node_mask) * CHAR_BIT + 1, 0);
+#else
+    fst::unused(data, size);
+#endif
+  }
+};
+#endif // __FST_LINUX__
+
 namespace detail {
   template <typename _BaseAllocator>
   struct shared_data_base_impl {
@@ -113,6 +353,43 @@ namespace detail {
   template <typename _BaseAllocator>
   using memory_pool_base = std::conditional_t<std::is_empty_v<_BaseAllocator>, empty_memory_pool_base,
       memory_pool_base_impl<_BaseAllocator>>;
+
+  template <class T>
+  using preferred_chunk_size_t = decltype(T::preferred_chunk_size);
+
+  template <class T>
+  using default_alignment_t = decltype(T::default_alignment);
+
+  template <class T>
+  using aligned_allocate_t = decltype(std::declval<T&>().allocate(std::size_t(), std::size_t()));
+
+  /// Alignment of the memory blocks of _BaseAllocator, alignof(std::max_align_t) when unspecified.
+  template <typename _BaseAllocator>
+  inline constexpr std::size_t get_default_alignment() {
+    if constexpr (fst::is_detected<default_alignment_t, _BaseAllocator>::value) {
+      return _BaseAllocator::default_alignment;
+    }
+    else {
+      return alignof(std::max_align_t);
+    }
+  }
+
+  /// Whether _BaseAllocator has an allocate(size, alignment) overload.
+  template <typename _BaseAllocator>
+  inline constexpr bool has_aligned_allocate = fst::is_detected<aligned_allocate_t, _BaseAllocator>::value;
+
+  /// Default capacity of the chunks allocated with _BaseAllocator.
+  /// Uses the preferred_chunk_size of the base allocator (minus the chunk header) when it has one.
+  template <typename _BaseAllocator, std::size_t _HeaderSize, std::size_t _DefaultCapacity = 64 * 1024>
+  inline constexpr std::size_t get_default_chunk_capacity() {
+    if constexpr (fst::is_detected<preferred_chunk_size_t, _BaseAllocator>::value) {
+      static_assert(_BaseAllocator::preferred_chunk_size > _HeaderSize, "preferred_chunk_size is too small.");
+      return _BaseAllocator::preferred_chunk_size - _HeaderSize;
+    }
+    else {
+      return _DefaultCapacity;
+    }
+  }
 } // namespace detail.
 
 /// MemoryPoolAllocator
@@ -125,23 +402,28 @@ namespace detail {
 /// If the user-buffer is full then additional chunks are allocated by BaseAllocator.
 /// The user-buffer is not deallocated by this allocator.
 /// @tparam BaseAllocator the allocator type for allocating memory chunks. Default is CrtAllocator.
+/// @tparam StatsPolicy allocator_stats_counter to keep O(1) allocation counters, no_allocator_stats by default.
 /// @note implements Allocator concept
 ///
-template <typename BaseAllocator = crt_allocator>
-class memory_pool_allocator : private detail::memory_pool_base<BaseAllocator>,
-                              public internal_allocator_base<memory_pool_allocator<BaseAllocator>, false, true> {
+template <typename BaseAllocator = crt_allocator, typename StatsPolicy = no_allocator_stats>
+class memory_pool_allocator
+    : private detail::memory_pool_base<BaseAllocator>,
+      public internal_allocator_base<memory_pool_allocator<BaseAllocator, StatsPolicy>, false, true> {
 
   using base = detail::memory_pool_base<BaseAllocator>;
-  static constexpr std::size_t default_alignement = 8;
-  static constexpr std::size_t default_chunk_capacity = 64 * 1024;
 
+public:
+  /// Alignment of the memory blocks returned by allocate(size).
+  static constexpr std::size_t default_alignment = 8;
+
+private:
   using base_empty = std::bool_constant<std::is_empty_v<BaseAllocator>>;
   using base_not_empty = std::bool_constant<!std::is_empty_v<BaseAllocator>>;
   static constexpr bool is_base_empty = base_empty::value;
 
   /// Chunk header for perpending to each chunk.
   /// Chunks are stored as a singly linked list.
-  struct alignas(default_alignement) chunk_header {
+  struct alignas(default_alignment) chunk_header {
     /// Capacity of the chunk in bytes (excluding the header itself).
     std::size_t capacity;
     /// Current size of allocated memory in bytes.
@@ -150,13 +432,16 @@ class memory_pool_allocator : private detail::memory_pool_base<BaseAllocator>,
     chunk_header* next;
   };
 
+  static constexpr std::size_t default_chunk_capacity
+      = detail::get_default_chunk_capacity<BaseAllocator, sizeof(chunk_header)>();
+
 public:
   struct refcount_type {
     bool own_buffer : 1; // = false;
     std::uint32_t refcount : 31; // = 0;
   };
 
-  struct alignas(default_alignement) shared_data : detail::shared_data_base<BaseAllocator> {
+  struct alignas(default_alignment) shared_data : detail::shared_data_base<BaseAllocator>, StatsPolicy {
     /// Head of the chunk linked-list. Only the head chunk serves allocation.
     chunk_header* chunk_head;
     refcount_type rc;
@@ -196,12 +481,14 @@ public:
       , _shared(static_cast<shared_data*>(BaseAllocator().allocate(minimum_content_size))) {
 
     fst_assert(_shared != 0, "");
+    ::new (_shared) shared_data();
     _shared->chunk_head = GetChunkHead(_shared);
     _shared->chunk_head->capacity = 0;
     _shared->chunk_head->size = 0;
     _shared->chunk_head->next = 0;
     _shared->rc.own_buffer = true;
     _shared->rc.refcount = 1;
+    get_stats_policy().add_chunk(0);
   }
 
   template <bool _Dummy = true, class = enable_if_has_base<_Dummy>>
@@ -214,6 +501,7 @@ public:
     fst_assert(base::baseAllocator_ != 0, "");
     fst_assert(_shared != 0, "");
 
+    ::new (_shared) shared_data();
     _shared->ownBaseAllocator = baseAllocator ? 0 : base::baseAllocator_;
     _shared->chunk_head = GetChunkHead(_shared);
     _shared->chunk_head->capacity = 0;
@@ -221,6 +509,7 @@ public:
     _shared->chunk_head->next = 0;
     _shared->rc.own_buffer = true;
     _shared->rc.refcount = 1;
+    get_stats_policy().add_chunk(0);
   }
 
   /// Constructor with user-supplied buffer.
@@ -238,6 +527,7 @@ public:
 
     fst_assert(size >= minimum_content_size, "");
 
+    ::new (_shared) shared_data();
     _shared->chunk_head = GetChunkHead(_shared);
     chunk_header& h = *_shared->chunk_head;
     h.capacity = size - minimum_content_size;
@@ -245,6 +535,7 @@ public:
     h.next = 0;
     _shared->rc.own_buffer = false;
     _shared->rc.refcount = 1;
+    get_stats_policy().add_chunk(h.capacity);
   }
 
   template <bool _Dummy = true, class = enable_if_has_base<_Dummy>>
@@ -256,6 +547,7 @@ public:
 
     fst_assert(size >= minimum_content_size, "");
 
+    ::new (_shared) shared_data();
     _shared->chunk_head = GetChunkHead(_shared);
     _shared->chunk_head->capacity = size - minimum_content_size;
     _shared->chunk_head->size = 0;
@@ -263,6 +555,7 @@ public:
     _shared->ownBaseAllocator = 0;
     _shared->rc.own_buffer = false;
     _shared->rc.refcount = 1;
+    get_stats_policy().add_chunk(_shared->chunk_head->capacity);
   }
 
   memory_pool_allocator(const memory_pool_allocator& rhs) noexcept
@@ -279,8 +572,8 @@ public:
   }
 
   memory_pool_allocator& operator=(const memory_pool_allocator& rhs) noexcept {
-    fst_noexcept_assert(rhs._shared->refcount > 0, "");
-    ++rhs._shared->refcount;
+    fst_noexcept_assert(rhs._shared->rc.refcount > 0, "");
+    ++rhs._shared->rc.refcount;
     this->~memory_pool_allocator();
     if constexpr (!is_base_empty) {
       base::baseAllocator_ = rhs.baseAllocator_;
@@ -304,7 +597,7 @@ public:
   }
 
   memory_pool_allocator& operator=(memory_pool_allocator&& rhs) noexcept {
-    fst_noexcept_assert(rhs._shared->refcount > 0, "");
+    fst_noexcept_assert(rhs._shared->rc.refcount > 0, "");
     this->~memory_pool_allocator();
     if constexpr (!is_base_empty) {
       base::baseAllocator_ = rhs.baseAllocator_;
@@ -331,7 +624,7 @@ public:
 
     if constexpr (!is_base_empty) {
       BaseAllocator* a = _shared->ownBaseAllocator;
-      if (_shared->own_buffer) {
+      if (_shared->rc.own_buffer) {
         base::baseAllocator_->free(_shared);
       }
       fst::memory::__delete(a);
@@ -353,6 +646,8 @@ public:
         break;
       }
       _shared->chunk_head = c->next;
+      get_stats_policy().remove_chunk(c->capacity);
+      get_stats_policy().remove_size(c->size);
 
       if constexpr (is_base_empty) {
         BaseAllocator().free(c);
@@ -363,13 +658,57 @@ public:
       //      baseAllocator_->free(c);
     }
 
+    get_stats_policy().remove_size(_shared->chunk_head->size);
     _shared->chunk_head->size = 0;
   }
 
+  /// Position in the pool returned by mark().
+  struct marker {
+    chunk_header* chunk;
+    std::size_t size;
+  };
+
+  /// Returns the current position of the pool.
+  inline marker mark() const noexcept {
+    fst_noexcept_assert(_shared->rc.refcount > 0, "");
+    return marker{ _shared->chunk_head, _shared->chunk_head->size };
+  }
+
+  /// Deallocates all memory blocks allocated since the marker was taken.
+  /// Chunks added after the marker are deallocated, markers taken after this one become invalid.
+  /// This is O(1) unless new chunks need to be deallocated.
+  void rewind(const marker& m) noexcept {
+    fst_noexcept_assert(_shared->rc.refcount > 0, "");
+
+    while (_shared->chunk_head != m.chunk) {
+      chunk_header* c = _shared->chunk_head;
+      fst_noexcept_assert(c->next, "Invalid marker.");
+      _shared->chunk_head = c->next;
+      get_stats_policy().remove_chunk(c->capacity);
+      get_stats_policy().remove_size(c->size);
+
+      if constexpr (is_base_empty) {
+        BaseAllocator().free(c);
+      }
+      else {
+        base::baseAllocator_->free(c);
+      }
+    }
+
+    fst_noexcept_assert(m.size <= _shared->chunk_head->size, "Invalid marker.");
+    get_stats_policy().remove_size(_shared->chunk_head->size - m.size);
+    _shared->chunk_head->size = m.size;
+  }
+
   /// Computes the total capacity of allocated memory chunks.
+  /// This is O(1) with the allocator_stats_counter policy.
   /// @return total capacity in bytes.
   std::size_t capacity() const noexcept {
-    fst_noexcept_assert(_shared->refcount > 0, "");
+    fst_noexcept_assert(_shared->rc.refcount > 0, "");
+    if constexpr (StatsPolicy::enabled) {
+      return get_stats_policy().get_stats().capacity;
+    }
+
     std::size_t capacity = 0;
     for (chunk_header* c = _shared->chunk_head; c != 0; c = c->next) {
       capacity += c->capacity;
@@ -378,9 +717,14 @@ public:
   }
 
   /// Computes the memory blocks allocated.
+  /// This is O(1) with the allocator_stats_counter policy.
   /// @return total used bytes.
   std::size_t size() const noexcept {
-    fst_noexcept_assert(_shared->refcount > 0, "");
+    fst_noexcept_assert(_shared->rc.refcount > 0, "");
+    if constexpr (StatsPolicy::enabled) {
+      return get_stats_policy().get_stats().size;
+    }
+
     std::size_t size = 0;
     for (chunk_header* c = _shared->chunk_head; c != 0; c = c->next) {
       size += c->size;
@@ -388,6 +732,13 @@ public:
     return size;
   }
 
+  /// Returns a snapshot of the counters, only available with the allocator_stats_counter policy.
+  inline allocator_stats get_stats() const noexcept {
+    static_assert(StatsPolicy::enabled, "get_stats requires a StatsPolicy such as allocator_stats_counter.");
+    fst_noexcept_assert(_shared->rc.refcount > 0, "");
+    return get_stats_policy().get_stats();
+  }
+
   /// Whether the allocator is shared.
   bool is_shared() const noexcept {
     fst_noexcept_assert(_shared->rc.refcount > 0, "");
@@ -402,7 +753,8 @@ public:
       return nullptr;
     }
 
-    size = fst::memory::aligned_size<default_alignement>(size);
+    const std::size_t requested_size = size;
+    size = fst::memory::aligned_size<default_alignment>(size);
 
     if (FST_UNLIKELY(_shared->chunk_head->size + size > _shared->chunk_head->capacity))
       if (!AddChunk(chunk_capacity_ > size ? chunk_capacity_ : size)) {
@@ -411,6 +763,41 @@ public:
 
     void* buffer = GetChunkBuffer(_shared) + _shared->chunk_head->size;
     _shared->chunk_head->size += size;
+    get_stats_policy().add_allocation(requested_size, size);
+    return buffer;
+  }
+
+  /// Allocates a memory block aligned on alignment, which must be a power of two.
+  /// The padding needed to align the block is lost, like the remaining space of a full chunk.
+  void* allocate(std::size_t size, std::size_t alignment) {
+    fst_noexcept_assert(_shared->rc.refcount > 0, "");
+    fst_noexcept_assert(fst::math::is_power_of_two(alignment), "alignment must be a power of two.");
+
+    if (alignment <= default_alignment) {
+      return allocate(size);
+    }
+
+    if (!size) {
+      return nullptr;
+    }
+
+    const std::size_t requested_size = size;
+    size = fst::memory::aligned_size<default_alignment>(size);
+    std::size_t padding = GetAlignmentPadding(alignment);
+
+    if (FST_UNLIKELY(_shared->chunk_head->size + padding + size > _shared->chunk_head->capacity)) {
+      // Chunk buffers are only aligned on default_alignment, makes room for the worst case padding.
+      const std::size_t capacity = size + alignment - default_alignment;
+      if (!AddChunk(chunk_capacity_ > capacity ? chunk_capacity_ : capacity)) {
+        return nullptr;
+      }
+
+      padding = GetAlignmentPadding(alignment);
+    }
+
+    void* buffer = GetChunkBuffer(_shared) + _shared->chunk_head->size + padding;
+    _shared->chunk_head->size += padding + size;
+    get_stats_policy().add_allocation(requested_size, padding + size);
     return buffer;
   }
 
@@ -425,8 +812,8 @@ public:
       return nullptr;
     }
 
-    originalSize = fst::memory::aligned_size<default_alignement>(originalSize);
-    newSize = fst::memory::aligned_size<default_alignement>(newSize);
+    originalSize = fst::memory::aligned_size<default_alignment>(originalSize);
+    newSize = fst::memory::aligned_size<default_alignment>(newSize);
 
     // Do not shrink if new size is smaller than original
     if (originalSize >= newSize) {
@@ -438,6 +825,7 @@ public:
       std::size_t increment = static_cast<std::size_t>(newSize - originalSize);
       if (_shared->chunk_head->size + increment <= _shared->chunk_head->capacity) {
         _shared->chunk_head->size += increment;
+        get_stats_policy().add_size(increment);
         return originalPtr;
       }
     }
@@ -459,8 +847,8 @@ public:
 
   /// Compare (equality) with another memory_pool_allocator
   inline bool operator==(const memory_pool_allocator& rhs) const noexcept {
-    fst_noexcept_assert(_shared->refcount > 0, "");
-    fst_noexcept_assert(rhs._shared->refcount > 0, "");
+    fst_noexcept_assert(_shared->rc.refcount > 0, "");
+    fst_noexcept_assert(rhs._shared->rc.refcount > 0, "");
     return _shared == rhs._shared;
   }
 
@@ -473,11 +861,12 @@ private:
   /// @return true if success.
   bool AddChunk(std::size_t capacity) {
     if constexpr (is_base_empty) {
-      if (chunk_header* chunk = static_cast<chunk_header*>(BaseAllocator().allocate(sizeof(shared_data) + capacity))) {
+      if (chunk_header* chunk = static_cast<chunk_header*>(BaseAllocator().allocate(sizeof(chunk_header) + capacity))) {
         chunk->capacity = capacity;
         chunk->size = 0;
         chunk->next = _shared->chunk_head;
         _shared->chunk_head = chunk;
+        get_stats_policy().add_chunk(capacity);
         return true;
       }
     }
@@ -488,17 +877,27 @@ private:
       }
 
       if (chunk_header* chunk
-          = static_cast<chunk_header*>(base::baseAllocator_->allocate(sizeof(shared_data) + capacity))) {
+          = static_cast<chunk_header*>(base::baseAllocator_->allocate(sizeof(chunk_header) + capacity))) {
         chunk->capacity = capacity;
         chunk->size = 0;
         chunk->next = _shared->chunk_head;
         _shared->chunk_head = chunk;
+        get_stats_policy().add_chunk(capacity);
         return true;
       }
     }
     return false;
   }
 
+  /// Number of bytes to skip in the head chunk for the next block to be aligned on alignment.
+  inline std::size_t GetAlignmentPadding(std::size_t alignment) const noexcept {
+    const std::uintptr_t ptr = reinterpret_cast<std::uintptr_t>(GetChunkBuffer(_shared) + _shared->chunk_head->size);
+    return static_cast<std::size_t>((alignment - (ptr & (alignment - 1))) & (alignment - 1));
+  }
+
+  inline StatsPolicy& get_stats_policy() noexcept { return *_shared; }
+  inline const StatsPolicy& get_stats_policy() const noexcept { return *_shared; }
+
   static inline void* AlignBuffer(void* buf, std::size_t& size) {
     fst_noexcept_assert(buf != 0, "");
     const std::uintptr_t mask = sizeof(void*) - 1;
@@ -520,114 +919,861 @@ private:
   shared_data* _shared;
 };
 
-namespace internal {
-  template <typename, typename = void>
-  struct IsRefCounted : public std::false_type {};
-
-  template <typename T>
-  struct IsRefCounted<T, typename fst::enable_if_cond<T::is_ref_counted>::type> : public std::true_type {};
-} // namespace internal
-
-namespace allocator_detail {
-  template <typename T, typename A>
-  inline T* realloc(A& a, T* old_p, std::size_t old_n, std::size_t new_n) {
-    fst_noexcept_assert(old_n <= SIZE_MAX / sizeof(T) && new_n <= SIZE_MAX / sizeof(T), "");
-    return static_cast<T*>(a.realloc(old_p, old_n * sizeof(T), new_n * sizeof(T)));
-  }
-
-  template <typename T, typename A>
-  inline T* malloc(A& a, std::size_t n = 1) {
-    return realloc<T, A>(a, nullptr, 0, n);
-  }
+/// scoped_arena_frame
+///
+/// Takes a marker of the pool on construction and rewinds the pool to it on destruction.
+/// Every memory block allocated from the pool during the lifetime of the frame is released.
+/// Frames can be nested but must be destroyed in reverse order of creation.
+/// @tparam PoolAllocator Any allocator with mark() and rewind(marker) (e.g. memory_pool_allocator).
+template <typename PoolAllocator>
+class scoped_arena_frame {
+public:
+  using pool_type = PoolAllocator;
+  using marker = typename pool_type::marker;
 
-  template <typename T, typename A>
-  inline void free(A& a, T* p, std::size_t n = 1) {
-    static_cast<void>(realloc<T, A>(a, p, n, 0));
-  }
-} // namespace allocator_detail.
+  inline scoped_arena_frame(pool_type& pool) noexcept
+      : _pool(pool)
+      , _marker(pool.mark()) {}
 
-template <typename T, typename _BaseAllocator = crt_allocator>
-class allocator : public std::allocator<T>,
-                  public internal_allocator_base<allocator<T, _BaseAllocator>, _BaseAllocator::is_freeable,
-                      _BaseAllocator::is_ref_counted> {
-  using allocator_type = std::allocator<T>;
-  using traits_type = std::allocator_traits<allocator_type>;
+  inline ~scoped_arena_frame() noexcept { _pool.rewind(_marker); }
 
-public:
-  using base_allocator_type = _BaseAllocator;
-  using propagate_on_container_move_assignment = std::true_type;
-  using propagate_on_container_swap = std::true_type;
+  scoped_arena_frame(const scoped_arena_frame&) = delete;
+  scoped_arena_frame(scoped_arena_frame&&) = delete;
 
-  using size_type = typename traits_type::size_type;
-  using difference_type = typename traits_type::difference_type;
+  scoped_arena_frame& operator=(const scoped_arena_frame&) = delete;
+  scoped_arena_frame& operator=(scoped_arena_frame&&) = delete;
 
-  using value_type = typename traits_type::value_type;
-  using pointer = typename traits_type::pointer;
-  using const_pointer = typename traits_type::const_pointer;
+  inline const marker& get_marker() const noexcept { return _marker; }
 
-  using reference = std::add_lvalue_reference_t<value_type>&;
-  using const_reference = std::add_lvalue_reference_t<std::add_const_t<value_type>>&;
+private:
+  pool_type& _pool;
+  marker _marker;
+};
 
-  using is_always_equal = std::is_empty<base_allocator_type>;
+namespace detail {
+  /// Small index unique to the calling thread, assigned on first use.
+  inline std::size_t get_thread_index() noexcept {
+    static std::atomic<std::size_t> counter = 0;
+    thread_local std::size_t index = counter.fetch_add(1, std::memory_order_relaxed);
+    return index;
+  }
+} // namespace detail.
 
-  allocator() noexcept = default;
-  allocator(const allocator& rhs) noexcept = default;
-  allocator(allocator&& rhs) noexcept = default;
+/// concurrent_memory_pool_allocator
+///
+/// Thread-safe version of the memory_pool_allocator.
+/// Every thread bumps into its own chunk (one per shard, selected from the thread index)
+/// so that allocate() never takes a lock. Exhausted chunks are replaced by chunks taken
+/// from a shared lock-free supply, or allocated by the BaseAllocator when the supply is empty.
+/// Blocks larger than the chunk size get a dedicated chunk.
+///
+/// Like the memory_pool_allocator, it does not free memory blocks and all memory is
+/// released when the last copy of the allocator is destroyed. Copies share the same pool
+/// with an atomic refcount and can be used from any thread.
+///
+/// @warning clear() and reserve() are not thread-safe.
+/// @tparam BaseAllocator the allocator type for allocating memory chunks. Default is crt_allocator.
+/// @note implements Allocator concept
+///
+template <typename BaseAllocator = crt_allocator>
+class concurrent_memory_pool_allocator
+    : public internal_allocator_base<concurrent_memory_pool_allocator<BaseAllocator>, false, true> {
+public:
+  /// Alignment of the memory blocks returned by allocate(size).
+  static constexpr std::size_t default_alignment = 8;
 
-  template <typename U>
-  allocator(const allocator<U, base_allocator_type>& rhs) noexcept
-      : allocator_type(rhs)
-      , _base_allocator(rhs._base_allocator) {}
+private:
+  static constexpr std::size_t cache_line_size = 64;
 
-  /// implicit.
-  allocator(const base_allocator_type& allocator) noexcept
-      : allocator_type()
-      , _base_allocator(allocator) {}
+  /// Chunk header for perpending to each chunk.
+  struct alignas(default_alignment) chunk_header {
+    /// Capacity of the chunk in bytes (excluding the header itself).
+    std::size_t capacity;
+    /// Bump offset in bytes, might go past the capacity once the chunk is exhausted.
+    std::atomic<std::size_t> size;
+    /// Next chunk in the list of all the chunks owned by the pool.
+    chunk_header* next;
+    /// Next chunk in the supply list.
+    chunk_header* next_free;
+  };
 
-  ~allocator() noexcept = default;
+  static constexpr std::size_t default_chunk_capacity
+      = detail::get_default_chunk_capacity<BaseAllocator, sizeof(chunk_header)>();
 
-  template <typename U>
-  struct rebind {
-    using other = allocator<U, base_allocator_type>;
+  struct alignas(cache_line_size) shard {
+    std::atomic<chunk_header*> chunk = nullptr;
   };
 
-  inline pointer address(reference r) const noexcept { return std::addressof(r); }
-  inline const_pointer address(const_reference r) const noexcept { return std::addressof(r); }
+public:
+  static constexpr std::size_t shard_count = 16;
+
+  struct shared_data {
+    shared_data(std::size_t chunkSize, const BaseAllocator& baseAllocator)
+        : chunk_capacity(chunkSize)
+        , base_allocator(baseAllocator) {}
+
+    /// Current chunk of each shard.
+    shard shards[shard_count];
+    /// All the chunks owned by the pool.
+    std::atomic<chunk_header*> chunk_list = nullptr;
+    /// Unused chunks ready to be handed to a shard.
+    std::atomic<chunk_header*> free_list = nullptr;
+    /// Only one thread at a time pops from the free_list, which makes it ABA safe.
+    std::atomic_flag free_list_pop_flag = ATOMIC_FLAG_INIT;
+    std::atomic<std::uint32_t> refcount = 1;
+    std::size_t chunk_capacity;
+    BaseAllocator base_allocator;
+  };
 
-  FST_NODISCARD inline size_type max_size() const noexcept { return traits_type::max_size(*this); }
+  /// Constructor with chunkSize.
+  /// @param chunkSize The size of memory chunk. The default is 64k or the preferred chunk size of the BaseAllocator.
+  /// @param baseAllocator The allocator for allocating memory chunks.
+  explicit concurrent_memory_pool_allocator(
+      std::size_t chunkSize = default_chunk_capacity, const BaseAllocator& baseAllocator = BaseAllocator())
+      : _shared(fst::memory::__new<shared_data>(
+          fst::memory::aligned_size<default_alignment>(chunkSize ? chunkSize : default_chunk_capacity),
+          baseAllocator)) {}
+
+  concurrent_memory_pool_allocator(const concurrent_memory_pool_allocator& rhs) noexcept
+      : _shared(rhs._shared) {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+    _shared->refcount.fetch_add(1, std::memory_order_relaxed);
+  }
 
-  template <typename... Args>
-  inline void construct(pointer p, Args&&... args) {
-    traits_type::construct(*this, p, std::forward<Args>(args)...);
+  concurrent_memory_pool_allocator(concurrent_memory_pool_allocator&& rhs) noexcept
+      : _shared(rhs._shared) {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+    rhs._shared = nullptr;
   }
 
-  inline void destroy(pointer p) { traits_type::destroy(*this, p); }
+  concurrent_memory_pool_allocator& operator=(const concurrent_memory_pool_allocator& rhs) noexcept {
+    fst_noexcept_assert(rhs._shared->refcount.load() > 0, "");
+    rhs._shared->refcount.fetch_add(1, std::memory_order_relaxed);
+    release();
+    _shared = rhs._shared;
+    return *this;
+  }
 
-  template <typename U>
-  inline U* allocate(size_type n = 1, const void* = 0) {
-    return fst::allocator_detail::malloc<U>(_base_allocator, n);
+  concurrent_memory_pool_allocator& operator=(concurrent_memory_pool_allocator&& rhs) noexcept {
+    if (this != &rhs) {
+      release();
+      _shared = rhs._shared;
+      rhs._shared = nullptr;
+    }
+    return *this;
   }
 
-  template <typename U>
-  inline void deallocate(U* p, size_type n = 1) {
+  /// Destructor.
+  /// The last copy deallocates all memory chunks.
+  inline ~concurrent_memory_pool_allocator() noexcept { release(); }
+
+  /// Allocates count chunks and adds them to the supply.
+  /// @return true if success.
+  bool reserve(std::size_t count) {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+    for (std::size_t i = 0; i < count; i++) {
+      chunk_header* c = new_chunk(_shared->chunk_capacity);
+      if (!c) {
+        return false;
+      }
+      push_free_chunk(c);
+    }
+    return true;
+  }
+
+  /// Resets all the chunks and moves them back to the supply.
+  /// Dedicated chunks of large blocks are deallocated.
+  /// @warning No other thread can use the pool while calling this.
+  void clear() noexcept {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+
+    for (shard& s : _shared->shards) {
+      s.chunk.store(nullptr, std::memory_order_relaxed);
+    }
+
+    chunk_header* c = _shared->chunk_list.exchange(nullptr, std::memory_order_acquire);
+    chunk_header* kept = nullptr;
+    chunk_header* free_list = nullptr;
+
+    while (c) {
+      chunk_header* next = c->next;
+      if (c->capacity == _shared->chunk_capacity) {
+        c->size.store(0, std::memory_order_relaxed);
+        c->next = kept;
+        c->next_free = free_list;
+        kept = c;
+        free_list = c;
+      }
+      else {
+        _shared->base_allocator.free(c);
+      }
+      c = next;
+    }
+
+    _shared->chunk_list.store(kept, std::memory_order_release);
+    _shared->free_list.store(free_list, std::memory_order_release);
+  }
+
+  /// Computes the total capacity of allocated memory chunks.
+  /// @return total capacity in bytes.
+  std::size_t capacity() const noexcept {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+    std::size_t capacity = 0;
+    for (chunk_header* c = _shared->chunk_list.load(std::memory_order_acquire); c != nullptr; c = c->next) {
+      capacity += c->capacity;
+    }
+    return capacity;
+  }
+
+  /// Computes the memory blocks allocated, including the unusable tail of exhausted chunks.
+  /// @return total used bytes.
+  std::size_t size() const noexcept {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+    std::size_t size = 0;
+    for (chunk_header* c = _shared->chunk_list.load(std::memory_order_acquire); c != nullptr; c = c->next) {
+      size += std::min(c->size.load(std::memory_order_relaxed), c->capacity);
+    }
+    return size;
+  }
+
+  /// Whether the allocator is shared.
+  bool is_shared() const noexcept {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+    return _shared->refcount.load(std::memory_order_relaxed) > 1;
+  }
+
+  /// Allocates a memory block. (concept Allocator)
+  void* allocate(std::size_t size) {
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+
+    if (!size) {
+      return nullptr;
+    }
+
+    size = fst::memory::aligned_size<default_alignment>(size);
+
+    if (FST_UNLIKELY(size > _shared->chunk_capacity)) {
+      chunk_header* c = new_chunk(size);
+      if (!c) {
+        return nullptr;
+      }
+
+      c->size.store(size, std::memory_order_relaxed);
+      return get_chunk_buffer(c);
+    }
+
+    std::atomic<chunk_header*>& current = get_shard().chunk;
+    chunk_header* c = current.load(std::memory_order_acquire);
+
+    for (;;) {
+      if (c) {
+        const std::size_t offset = c->size.fetch_add(size, std::memory_order_relaxed);
+        if (offset + size <= c->capacity) {
+          return get_chunk_buffer(c) + offset;
+        }
+      }
+
+      chunk_header* n = acquire_chunk();
+      if (!n) {
+        return nullptr;
+      }
+
+      if (current.compare_exchange_strong(c, n, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        c = n;
+      }
+      else {
+        // Another thread of this shard already replaced the chunk.
+        push_free_chunk(n);
+      }
+    }
+  }
+
+  /// Resizes a memory block (concept Allocator)
+  void* realloc(void* originalPtr, std::size_t originalSize, std::size_t newSize) {
+    if (originalPtr == nullptr) {
+      return allocate(newSize);
+    }
+
+    fst_noexcept_assert(_shared->refcount.load() > 0, "");
+    if (newSize == 0) {
+      return nullptr;
+    }
+
+    originalSize = fst::memory::aligned_size<default_alignment>(originalSize);
+    newSize = fst::memory::aligned_size<default_alignment>(newSize);
+
+    // Do not shrink if new size is smaller than original
+    if (originalSize >= newSize) {
+      return originalPtr;
+    }
+
+    // Simply expand it if it is the last allocation of the current chunk and there is sufficient space.
+    if (chunk_header* c = get_shard().chunk.load(std::memory_order_acquire)) {
+      std::uint8_t* buffer = get_chunk_buffer(c);
+      std::uint8_t* ptr = static_cast<std::uint8_t*>(originalPtr);
+
+      if (ptr >= buffer && ptr < buffer + c->capacity) {
+        std::size_t end = static_cast<std::size_t>(ptr - buffer) + originalSize;
+        const std::size_t new_end = end + (newSize - originalSize);
+
+        if (new_end <= c->capacity && c->size.compare_exchange_strong(end, new_end, std::memory_order_relaxed)) {
+          return originalPtr;
+        }
+      }
+    }
+
+    // Realloc process: allocate and copy memory, do not free original buffer.
+    if (void* newBuffer = allocate(newSize)) {
+      std::memcpy(newBuffer, originalPtr, originalSize);
+      return newBuffer;
+    }
+
+    return nullptr;
+  }
+
+  /// Frees a memory block (concept Allocator)
+  /// Does nothing.
+  inline static void free(void* ptr) noexcept { fst::unused(ptr); }
+
+  /// Compare (equality) with another concurrent_memory_pool_allocator
+  inline bool operator==(const concurrent_memory_pool_allocator& rhs) const noexcept {
+    return _shared == rhs._shared;
+  }
+
+  /// Compare (inequality) with another concurrent_memory_pool_allocator
+  inline bool operator!=(const concurrent_memory_pool_allocator& rhs) const noexcept { return !operator==(rhs); }
+
+private:
+  static inline std::uint8_t* get_chunk_buffer(chunk_header* c) noexcept {
+    return reinterpret_cast<std::uint8_t*>(c) + sizeof(chunk_header);
+  }
+
+  inline shard& get_shard() noexcept { return _shared->shards[detail::get_thread_index() % shard_count]; }
+
+  /// Allocates a new chunk and adds it to the chunk list.
+  chunk_header* new_chunk(std::size_t capacity) {
+    void* data = _shared->base_allocator.allocate(sizeof(chunk_header) + capacity);
+    if (!data) {
+      return nullptr;
+    }
+
+    chunk_header* c = ::new (data) chunk_header{ capacity, { 0 }, nullptr, nullptr };
+    c->next = _shared->chunk_list.load(std::memory_order_relaxed);
+    while (!_shared->chunk_list.compare_exchange_weak(
+        c->next, c, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+
+    return c;
+  }
+
+  /// Takes a chunk from the supply or allocates a new one.
+  chunk_header* acquire_chunk() {
+    if (chunk_header* c = pop_free_chunk()) {
+      return c;
+    }
+    return new_chunk(_shared->chunk_capacity);
+  }
+
+  void push_free_chunk(chunk_header* c) noexcept {
+    c->next_free = _shared->free_list.load(std::memory_order_relaxed);
+    while (!_shared->free_list.compare_exchange_weak(
+        c->next_free, c, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+  }
+
+  /// Never waits, returns nullptr if the supply is empty or if another thread is popping.
+  chunk_header* pop_free_chunk() noexcept {
+    if (_shared->free_list.load(std::memory_order_relaxed) == nullptr
+        || _shared->free_list_pop_flag.test_and_set(std::memory_order_acquire)) {
+      return nullptr;
+    }
+
+    chunk_header* c = _shared->free_list.load(std::memory_order_acquire);
+    while (c
+        && !_shared->free_list.compare_exchange_weak(
+            c, c->next_free, std::memory_order_acquire, std::memory_order_acquire)) {
+    }
+
+    _shared->free_list_pop_flag.clear(std::memory_order_release);
+    return c;
+  }
+
+  void release() noexcept {
+    if (!_shared) {
+      // do nothing if moved
+      return;
+    }
+
+    if (_shared->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      chunk_header* c = _shared->chunk_list.load(std::memory_order_acquire);
+      while (c) {
+        chunk_header* next = c->next;
+        _shared->base_allocator.free(c);
+        c = next;
+      }
+
+      fst::memory::__delete<shared_data>(_shared);
+    }
+
+    _shared = nullptr;
+  }
+
+  /// The shared data of the allocator.
+  shared_data* _shared;
+};
+
+/// size_class_pool_allocator
+///
+/// Memory allocator with segregated free lists.
+/// Small blocks are rounded up to a size class and carved from chunks allocated by the BaseAllocator.
+/// Freed blocks are kept in the free list of their size class and reused by the next allocation
+/// of the same class, so a container that grows and shrinks doesn't keep asking for new memory.
+/// Blocks larger than MaxSmallSize are forwarded to the BaseAllocator.
+///
+/// Chunks are only given back to the BaseAllocator when the last copy of the allocator is destroyed.
+/// Like the memory_pool_allocator, this allocator is reference counted on copy and is not thread-safe.
+///
+/// @tparam BaseAllocator the allocator type for allocating memory chunks and large blocks.
+/// @tparam MaxSmallSize the largest block size served by the free lists.
+/// @note implements Allocator concept, free() requires the size of the block.
+///
+template <typename BaseAllocator = crt_allocator, std::size_t MaxSmallSize = 256>
+class size_class_pool_allocator
+    : public internal_allocator_base<size_class_pool_allocator<BaseAllocator, MaxSmallSize>, true, true> {
+public:
+  /// Alignment of the memory blocks returned by allocate(size).
+  static constexpr std::size_t default_alignment = 8;
+
+private:
+  static_assert(MaxSmallSize >= default_alignment && MaxSmallSize % default_alignment == 0,
+      "MaxSmallSize must be a multiple of 8.");
+
+  /// Chunk header for perpending to each chunk.
+  /// Chunks are stored as a singly linked list.
+  struct alignas(default_alignment) chunk_header {
+    /// Capacity of the chunk in bytes (excluding the header itself).
+    std::size_t capacity;
+    /// Next chunk in the linked list.
+    chunk_header* next;
+  };
+
+  static constexpr std::size_t default_chunk_capacity
+      = detail::get_default_chunk_capacity<BaseAllocator, sizeof(chunk_header)>();
+
+  /// Freed blocks are linked through their own memory.
+  struct free_block {
+    free_block* next;
+  };
+
+public:
+  static constexpr std::size_t max_small_size = MaxSmallSize;
+  static constexpr std::size_t size_class_count = MaxSmallSize / default_alignment;
+
+  struct shared_data {
+    shared_data(std::size_t chunkSize, const BaseAllocator& baseAllocator)
+        : chunk_capacity(chunkSize)
+        , base_allocator(baseAllocator) {}
+
+    /// Head of the free list of each size class.
+    free_block* free_lists[size_class_count] = {};
+    /// Head of the chunk linked-list. Only the head chunk serves new blocks.
+    chunk_header* chunk_head = nullptr;
+    /// Number of bytes used in the head chunk.
+    std::size_t chunk_size = 0;
+    std::size_t chunk_capacity;
+    std::uint32_t refcount = 1;
+    BaseAllocator base_allocator;
+  };
+
+  /// Returns the size of the blocks of a size class.
+  static constexpr std::size_t get_class_size(std::size_t index) noexcept {
+    return (index + 1) * default_alignment;
+  }
+
+  /// Returns the size class index of a small block size.
+  static constexpr std::size_t get_size_class(std::size_t size) noexcept {
+    fst_cexpr_assert(size > 0 && size <= max_small_size);
+    return (size - 1) / default_alignment;
+  }
+
+  /// Constructor with chunkSize.
+  /// @param chunkSize The size of memory chunk. The default is 64k or the preferred chunk size of the BaseAllocator.
+  /// @param baseAllocator The allocator for allocating memory chunks and large blocks.
+  explicit size_class_pool_allocator(
+      std::size_t chunkSize = default_chunk_capacity, const BaseAllocator& baseAllocator = BaseAllocator())
+      : _shared(fst::memory::__new<shared_data>(
+          std::max(fst::memory::aligned_size<default_alignment>(chunkSize), max_small_size), baseAllocator)) {}
+
+  size_class_pool_allocator(const size_class_pool_allocator& rhs) noexcept
+      : _shared(rhs._shared) {
+    fst_noexcept_assert(_shared->refcount > 0, "");
+    ++_shared->refcount;
+  }
+
+  size_class_pool_allocator(size_class_pool_allocator&& rhs) noexcept
+      : _shared(rhs._shared) {
+    fst_noexcept_assert(_shared->refcount > 0, "");
+    rhs._shared = nullptr;
+  }
+
+  size_class_pool_allocator& operator=(const size_class_pool_allocator& rhs) noexcept {
+    fst_noexcept_assert(rhs._shared->refcount > 0, "");
+    ++rhs._shared->refcount;
+    release();
+    _shared = rhs._shared;
+    return *this;
+  }
+
+  size_class_pool_allocator& operator=(size_class_pool_allocator&& rhs) noexcept {
+    if (this != &rhs) {
+      release();
+      _shared = rhs._shared;
+      rhs._shared = nullptr;
+    }
+    return *this;
+  }
+
+  /// Destructor.
+  /// The last copy deallocates all memory chunks.
+  /// Large blocks that were not freed are not deallocated.
+  inline ~size_class_pool_allocator() noexcept { release(); }
+
+  /// Computes the total capacity of allocated memory chunks.
+  /// @return total capacity in bytes.
+  std::size_t capacity() const noexcept {
+    fst_noexcept_assert(_shared->refcount > 0, "");
+    std::size_t capacity = 0;
+    for (chunk_header* c = _shared->chunk_head; c != nullptr; c = c->next) {
+      capacity += c->capacity;
+    }
+    return capacity;
+  }
+
+  /// Whether the allocator is shared.
+  bool is_shared() const noexcept {
+    fst_noexcept_assert(_shared->refcount > 0, "");
+    return _shared->refcount > 1;
+  }
+
+  /// Allocates a memory block. (concept Allocator)
+  void* allocate(std::size_t size) {
+    fst_noexcept_assert(_shared->refcount > 0, "");
+
+    if (!size) {
+      return nullptr;
+    }
+
+    if (size > max_small_size) {
+      return _shared->base_allocator.allocate(size);
+    }
+
+    const std::size_t index = get_size_class(size);
+
+    if (free_block* block = _shared->free_lists[index]) {
+      _shared->free_lists[index] = block->next;
+      return block;
+    }
+
+    const std::size_t class_size = get_class_size(index);
+
+    if (FST_UNLIKELY(!_shared->chunk_head || _shared->chunk_size + class_size > _shared->chunk_head->capacity)) {
+      if (!add_chunk()) {
+        return nullptr;
+      }
+    }
+
+    void* buffer = get_chunk_buffer(_shared->chunk_head) + _shared->chunk_size;
+    _shared->chunk_size += class_size;
+    return buffer;
+  }
+
+  /// Resizes a memory block (concept Allocator)
+  /// Blocks staying in the same size class are not moved.
+  void* realloc(void* originalPtr, std::size_t originalSize, std::size_t newSize) {
+    if (originalPtr == nullptr) {
+      return allocate(newSize);
+    }
+
+    fst_noexcept_assert(_shared->refcount > 0, "");
+
+    if (newSize == 0) {
+      free(originalPtr, originalSize);
+      return nullptr;
+    }
+
+    if (originalSize > max_small_size && newSize > max_small_size) {
+      return _shared->base_allocator.realloc(originalPtr, originalSize, newSize);
+    }
+
+    if (originalSize <= max_small_size && newSize <= max_small_size
+        && get_size_class(originalSize) == get_size_class(newSize)) {
+      return originalPtr;
+    }
+
+    void* newBuffer = allocate(newSize);
+    if (!newBuffer) {
+      return nullptr;
+    }
+
+    std::memcpy(newBuffer, originalPtr, std::min(originalSize, newSize));
+    free(originalPtr, originalSize);
+    return newBuffer;
+  }
+
+  /// Frees a memory block (concept Allocator)
+  /// Small blocks are pushed to the free list of their size class.
+  /// @param size The size that was given to allocate().
+  inline void free(void* ptr, std::size_t size) noexcept {
+    if (!ptr) {
+      return;
+    }
+
+    if (size > max_small_size) {
+      _shared->base_allocator.free(ptr);
+      return;
+    }
+
+    const std::size_t index = get_size_class(size);
+    free_block* block = static_cast<free_block*>(ptr);
+    block->next = _shared->free_lists[index];
+    _shared->free_lists[index] = block;
+  }
+
+  /// Compare (equality) with another size_class_pool_allocator
+  inline bool operator==(const size_class_pool_allocator& rhs) const noexcept { return _shared == rhs._shared; }
+
+  /// Compare (inequality) with another size_class_pool_allocator
+  inline bool operator!=(const size_class_pool_allocator& rhs) const noexcept { return !operator==(rhs); }
+
+private:
+  static inline std::uint8_t* get_chunk_buffer(chunk_header* c) noexcept {
+    return reinterpret_cast<std::uint8_t*>(c) + sizeof(chunk_header);
+  }
+
+  /// Creates a new chunk, the remaining space of the current one goes to a free list.
+  /// @return true if success.
+  bool add_chunk() {
+    const std::size_t capacity = _shared->chunk_capacity;
+    chunk_header* chunk = static_cast<chunk_header*>(_shared->base_allocator.allocate(sizeof(chunk_header) + capacity));
+
+    if (!chunk) {
+      return false;
+    }
+
+    if (chunk_header* head = _shared->chunk_head) {
+      const std::size_t remaining = head->capacity - _shared->chunk_size;
+      if (remaining >= default_alignment) {
+        free(get_chunk_buffer(head) + _shared->chunk_size, remaining - remaining % default_alignment);
+      }
+    }
+
+    chunk->capacity = capacity;
+    chunk->next = _shared->chunk_head;
+    _shared->chunk_head = chunk;
+    _shared->chunk_size = 0;
+    return true;
+  }
+
+  void release() noexcept {
+    if (!_shared) {
+      // do nothing if moved
+      return;
+    }
+
+    if (--_shared->refcount == 0) {
+      chunk_header* c = _shared->chunk_head;
+      while (c) {
+        chunk_header* next = c->next;
+        _shared->base_allocator.free(c);
+        c = next;
+      }
+
+      fst::memory::__delete<shared_data>(_shared);
+    }
+
+    _shared = nullptr;
+  }
+
+  /// The shared data of the allocator.
+  shared_data* _shared;
+};
+
+namespace internal {
+  template <typename, typename = void>
+  struct IsRefCounted : public std::false_type {};
+
+  template <typename T>
+  struct IsRefCounted<T, typename fst::enable_if_cond<T::is_ref_counted>::type> : public std::true_type {};
+} // namespace internal
+
+namespace allocator_detail {
+  template <typename T, typename A>
+  inline T* realloc(A& a, T* old_p, std::size_t old_n, std::size_t new_n) {
+    fst_noexcept_assert(old_n <= SIZE_MAX / sizeof(T) && new_n <= SIZE_MAX / sizeof(T), "");
+    return static_cast<T*>(a.realloc(old_p, old_n * sizeof(T), new_n * sizeof(T)));
+  }
+
+  template <typename T, typename A>
+  inline T* malloc(A& a, std::size_t n = 1) {
+    return realloc<T, A>(a, nullptr, 0, n);
+  }
+
+  template <typename T, typename A>
+  inline void free(A& a, T* p, std::size_t n = 1) {
+    static_cast<void>(realloc<T, A>(a, p, n, 0));
+  }
+
+  /// Pointer to the stats policy of an allocator, empty when the policy is disabled.
+  template <typename _StatsPolicy, bool = _StatsPolicy::enabled>
+  struct stats_ref {
+    stats_ref() noexcept = default;
+    stats_ref(_StatsPolicy* stats) noexcept
+        : _stats(stats) {}
+
+    _StatsPolicy* _stats = nullptr;
+  };
+
+  template <typename _StatsPolicy>
+  struct stats_ref<_StatsPolicy, false> {
+    stats_ref() noexcept = default;
+    stats_ref(_StatsPolicy*) noexcept {}
+  };
+} // namespace allocator_detail.
+
+/// @tparam _StatsPolicy allocator_stats_counter to count the allocations made through the allocator
+///                      and all its copies in the policy object given to the constructor.
+template <typename T, typename _BaseAllocator = crt_allocator, typename _StatsPolicy = no_allocator_stats>
+class allocator : public std::allocator<T>,
+                  public internal_allocator_base<allocator<T, _BaseAllocator, _StatsPolicy>,
+                      _BaseAllocator::is_freeable, _BaseAllocator::is_ref_counted>,
+                  private allocator_detail::stats_ref<_StatsPolicy> {
+  using allocator_type = std::allocator<T>;
+  using traits_type = std::allocator_traits<allocator_type>;
+  using stats_ref_type = allocator_detail::stats_ref<_StatsPolicy>;
+
+public:
+  using base_allocator_type = _BaseAllocator;
+  using stats_policy_type = _StatsPolicy;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  using size_type = typename traits_type::size_type;
+  using difference_type = typename traits_type::difference_type;
+
+  using value_type = typename traits_type::value_type;
+  using pointer = typename traits_type::pointer;
+  using const_pointer = typename traits_type::const_pointer;
+
+  using reference = std::add_lvalue_reference_t<value_type>&;
+  using const_reference = std::add_lvalue_reference_t<std::add_const_t<value_type>>&;
+
+  using is_always_equal = std::is_empty<base_allocator_type>;
+
+  allocator() noexcept = default;
+  allocator(const allocator& rhs) noexcept = default;
+  allocator(allocator&& rhs) noexcept = default;
+
+  allocator& operator=(const allocator& rhs) noexcept = default;
+  allocator& operator=(allocator&& rhs) noexcept = default;
+
+  template <typename U>
+  allocator(const allocator<U, base_allocator_type, stats_policy_type>& rhs) noexcept
+      : allocator_type(rhs)
+      , stats_ref_type(rhs)
+      , _base_allocator(rhs._base_allocator) {}
+
+  /// implicit.
+  allocator(const base_allocator_type& allocator) noexcept
+      : allocator_type()
+      , _base_allocator(allocator) {}
+
+  /// The stats policy must outlive the allocator and all its copies.
+  allocator(const base_allocator_type& allocator, stats_policy_type& stats) noexcept
+      : allocator_type()
+      , stats_ref_type(&stats)
+      , _base_allocator(allocator) {
+    static_assert(stats_policy_type::enabled, "stats_policy_type must be enabled.");
+  }
+
+  ~allocator() noexcept = default;
+
+  template <typename U>
+  struct rebind {
+    using other = allocator<U, base_allocator_type, stats_policy_type>;
+  };
+
+  inline pointer address(reference r) const noexcept { return std::addressof(r); }
+  inline const_pointer address(const_reference r) const noexcept { return std::addressof(r); }
+
+  FST_NODISCARD inline size_type max_size() const noexcept { return traits_type::max_size(*this); }
+
+  template <typename... Args>
+  inline void construct(pointer p, Args&&... args) {
+    traits_type::construct(*this, p, std::forward<Args>(args)...);
+  }
+
+  inline void destroy(pointer p) { traits_type::destroy(*this, p); }
+
+  /// Over-aligned types are allocated with the allocate(size, alignment) overload of the base allocator.
+  template <typename U>
+  inline U* allocate(size_type n = 1, const void* = 0) {
+    U* p;
+
+    if constexpr (alignof(U) > detail::get_default_alignment<base_allocator_type>()) {
+      static_assert(detail::has_aligned_allocate<base_allocator_type>,
+          "base_allocator_type doesn't support over-aligned types.");
+      fst_noexcept_assert(n <= SIZE_MAX / sizeof(U), "");
+      p = static_cast<U*>(_base_allocator.allocate(n * sizeof(U), alignof(U)));
+    }
+    else {
+      p = fst::allocator_detail::malloc<U>(_base_allocator, n);
+    }
+
+    if constexpr (stats_policy_type::enabled) {
+      if (p && this->_stats) {
+        this->_stats->add_allocation(n * sizeof(U), n * sizeof(U));
+      }
+    }
+
+    return p;
+  }
+
+  template <typename U>
+  inline void deallocate(U* p, size_type n = 1) {
+    if constexpr (stats_policy_type::enabled) {
+      if (p && this->_stats) {
+        this->_stats->add_deallocation(n * sizeof(U));
+      }
+    }
+
     fst::allocator_detail::free<U>(_base_allocator, p, n);
   }
 
+  /// Returns the stats policy given to the constructor, nullptr if none.
+  inline stats_policy_type* get_stats_policy() const noexcept {
+    if constexpr (stats_policy_type::enabled) {
+      return this->_stats;
+    }
+    else {
+      return nullptr;
+    }
+  }
+
   inline pointer allocate(size_type n = 1, const void* = 0) { return allocate<value_type>(n); }
   inline void deallocate(pointer p, size_type n = 1) { deallocate<value_type>(p, n); }
 
   template <typename U>
-  inline bool operator==(const allocator<U, base_allocator_type>& rhs) const noexcept {
+  inline bool operator==(const allocator<U, base_allocator_type, stats_policy_type>& rhs) const noexcept {
     return _base_allocator == rhs._base_allocator;
   }
 
   template <typename U>
-  inline bool operator!=(const allocator<U, base_allocator_type>& rhs) const noexcept {
+  inline bool operator!=(const allocator<U, base_allocator_type, stats_policy_type>& rhs) const noexcept {
     return !operator==(rhs);
   }
 
 private:
-  template <typename, typename>
+  template <typename, typename, typename>
   friend class allocator; // access to allocator<!T>.*
 
   base_allocator_type _base_allocator;
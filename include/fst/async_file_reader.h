@@ -0,0 +1,818 @@
+///
+/// BSD 3-Clause License
+///
+/// Copyright (c) 2021, Alexandre Arsenault
+/// All rights reserved.
+///
+/// Redistribution and use in source and binary forms, with or without
+/// modification, are permitted provided that the following conditions are met:
+///
+/// * Redistributions of source code must retain the above copyright notice, this
+///   list of conditions and the following disclaimer.
+///
+/// * Redistributions in binary form must reproduce the above copyright notice,
+///   this list of conditions and the following disclaimer in the documentation
+///   and/or other materials provided with the distribution.
+///
+/// * Neither the name of the copyright holder nor the names of its
+///   contributors may be used to endorse or promote products derived from
+///   this software without specific prior written permission.
+///
+/// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+/// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+/// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+/// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+/// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+/// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+/// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+/// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+/// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+/// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+/// POSSIBILITY OF SUCH DAMAGE.
+///
+
+#pragma once
+#include <fst/assert>
+#include <fst/byte_view>
+#include <fst/config>
+#include <fst/inplace_function>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// clang-format off
+#if __FST_WINDOWS__
+  #include FST_WINDOWS_H
+  #define __FST_ASYNC_FILE_READER_USE_IO_URING 0
+
+#elif __FST_UNISTD__
+  #include <fcntl.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+
+  #if __FST_LINUX__ && __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #define __FST_ASYNC_FILE_READER_USE_IO_URING 1
+  #else
+    #define __FST_ASYNC_FILE_READER_USE_IO_URING 0
+  #endif
+#endif
+// clang-format on
+
+namespace fst {
+/// Options of async_file_reader::open().
+struct async_file_reader_options {
+  /// Maximum size of a single read.
+  std::size_t buffer_size = 1024 * 1024;
+
+  /// Maximum number of reads in flight.
+  std::size_t buffer_count = 32;
+
+  std::size_t alignment = 4096;
+
+  /// Threads used when falling back to pread().
+  std::size_t thread_count = 2;
+
+  bool use_io_uring = true;
+};
+
+/// async_file_reader
+///
+/// Reads byte ranges of a file in the background, into a fixed pool of aligned buffers.
+///
+/// On Linux, reads are submitted to an io_uring and completed by a single thread waiting on it.
+/// Elsewhere, or when io_uring is not available, a few threads run blocking pread() calls.
+///
+/// Each read gets a buffer from the pool and is completed with a completion holding it,
+/// either through a callback called on a reader thread or through a std::future. The buffer
+/// goes back to the pool when the completion is destroyed, read() blocks while all of them are
+/// in use. A callback must not wait for another read to complete.
+class async_file_reader {
+public:
+  using value_type = std::uint8_t;
+  using size_type = std::size_t;
+  using offset_type = std::uint64_t;
+
+  static constexpr size_type callback_capacity = 64;
+
+  enum class backend_type { none, io_uring, thread_pool };
+
+  using options = async_file_reader_options;
+
+  /// Pooled buffer, returned to the pool on destruction.
+  class buffer {
+  public:
+    buffer() noexcept = default;
+
+    inline buffer(buffer&& b) noexcept
+        : _reader(b._reader)
+        , _index(b._index)
+        , _size(b._size) {
+      b._reader = nullptr;
+      b._size = 0;
+    }
+
+    inline ~buffer() { reset(); }
+
+    buffer(const buffer&) = delete;
+    buffer& operator=(const buffer&) = delete;
+
+    inline buffer& operator=(buffer&& b) noexcept {
+      if (this != &b) {
+        reset();
+        _reader = b._reader;
+        _index = b._index;
+        _size = b._size;
+        b._reader = nullptr;
+        b._size = 0;
+      }
+      return *this;
+    }
+
+    inline const value_type* data() const noexcept { return _reader ? _reader->buffer_data(_index) : nullptr; }
+    inline size_type size() const noexcept { return _size; }
+    inline bool empty() const noexcept { return _size == 0; }
+    inline fst::byte_view view() const noexcept { return fst::byte_view(data(), _size); }
+
+    inline void reset() noexcept {
+      if (_reader) {
+        _reader->release(_index);
+        _reader = nullptr;
+        _size = 0;
+      }
+    }
+
+  private:
+    friend class async_file_reader;
+
+    inline buffer(async_file_reader* reader, std::uint32_t index, size_type size) noexcept
+        : _reader(reader)
+        , _index(index)
+        , _size(size) {}
+
+    async_file_reader* _reader = nullptr;
+    std::uint32_t _index = 0;
+    size_type _size = 0;
+  };
+
+  struct completion {
+    offset_type offset = 0;
+
+    /// Bytes read, shorter than requested at the end of the file or on error.
+    buffer data;
+
+    /// errno (GetLastError() on Windows), 0 on success.
+    int error = 0;
+
+    inline bool ok() const noexcept { return error == 0; }
+    inline fst::byte_view view() const noexcept { return data.view(); }
+  };
+
+  using callback_type = fst::inplace_function<void(completion&&), callback_capacity>;
+
+  async_file_reader() noexcept = default;
+
+  inline ~async_file_reader() { close(); }
+
+  async_file_reader(const async_file_reader&) = delete;
+  async_file_reader(async_file_reader&&) = delete;
+
+  async_file_reader& operator=(const async_file_reader&) = delete;
+  async_file_reader& operator=(async_file_reader&&) = delete;
+
+  bool open(const std::filesystem::path& file_path, const options& opts = {}) {
+    close();
+
+    if (opts.buffer_size == 0 || opts.buffer_count == 0 || opts.alignment == 0
+        || (opts.alignment & (opts.alignment - 1))) {
+      return false;
+    }
+
+    if (!open_file(file_path)) {
+      return false;
+    }
+
+    _buffer_size = opts.buffer_size;
+    _buffer_stride = ((opts.buffer_size + opts.alignment - 1) / opts.alignment) * opts.alignment;
+    _alignment = opts.alignment;
+    _memory = (value_type*)::operator new(_buffer_stride * opts.buffer_count, std::align_val_t(_alignment));
+
+    _requests = std::vector<request>(opts.buffer_count);
+    _free_list.resize(opts.buffer_count);
+    for (size_type i = 0; i < opts.buffer_count; i++) {
+      _free_list[i] = (std::uint32_t)(opts.buffer_count - 1 - i);
+    }
+
+    _stop = false;
+
+#if __FST_ASYNC_FILE_READER_USE_IO_URING
+    if (opts.use_io_uring && _ring.init((unsigned)opts.buffer_count)) {
+      _backend = backend_type::io_uring;
+      _ring_error = 0;
+      _threads.emplace_back([this]() { ring_loop(); });
+      return true;
+    }
+#endif
+
+    _backend = backend_type::thread_pool;
+    for (size_type i = 0; i < std::max<size_type>(opts.thread_count, 1); i++) {
+      _threads.emplace_back([this]() { pool_loop(); });
+    }
+
+    return true;
+  }
+
+  /// Waits for every pending read to complete, then closes the file.
+  /// Buffers of completions still alive must be released before this call.
+  void close() {
+    if (_backend == backend_type::none) {
+      return;
+    }
+
+    wait();
+
+#if __FST_ASYNC_FILE_READER_USE_IO_URING
+    if (_backend == backend_type::io_uring) {
+      // A nop with no request stops the completion thread.
+      _ring.submit_nop();
+    }
+#endif
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+
+    _queue_cv.notify_all();
+
+    for (std::thread& t : _threads) {
+      t.join();
+    }
+
+    _threads.clear();
+
+#if __FST_ASYNC_FILE_READER_USE_IO_URING
+    _ring.release();
+#endif
+
+    fst_assert(_free_list.size() == _requests.size(), "async_file_reader::close buffers still in use");
+
+    _requests.clear();
+    _free_list.clear();
+    ::operator delete(_memory, std::align_val_t(_alignment));
+    _memory = nullptr;
+
+    close_file();
+    _backend = backend_type::none;
+  }
+
+  inline bool is_open() const noexcept { return _backend != backend_type::none; }
+  inline backend_type backend() const noexcept { return _backend; }
+  inline offset_type file_size() const noexcept { return _file_size; }
+  inline size_type buffer_size() const noexcept { return _buffer_size; }
+
+  /// Reads up to count bytes at offset, fct is called on a reader thread once done.
+  /// Returns false if the reader isn't open or count is larger than the buffer size.
+  inline bool read(offset_type offset, size_type count, callback_type fct) {
+    const std::uint32_t index = acquire(offset, count);
+    if (index == invalid_index) {
+      return false;
+    }
+
+    _requests[index].callback = std::move(fct);
+    submit(index);
+    return true;
+  }
+
+  /// Reads up to count bytes at offset, the future is ready once done.
+  /// The future holds a completion with EINVAL if the reader isn't open or count is too large.
+  inline std::future<completion> read(offset_type offset, size_type count) {
+    const std::uint32_t index = acquire(offset, count);
+    if (index == invalid_index) {
+      std::promise<completion> promise;
+      completion c;
+      c.offset = offset;
+      c.error = EINVAL;
+      promise.set_value(std::move(c));
+      return promise.get_future();
+    }
+
+    request& r = _requests[index];
+    r.promise = std::promise<completion>();
+    r.has_promise = true;
+    std::future<completion> future = r.promise.get_future();
+    submit(index);
+    return future;
+  }
+
+  /// Waits until every read submitted so far has completed, callbacks included.
+  inline void wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done_cv.wait(lock, [this]() { return _pending == 0; });
+  }
+
+private:
+  static constexpr std::uint32_t invalid_index = 0xFFFFFFFF;
+
+  struct request {
+    callback_type callback;
+    std::promise<completion> promise;
+    bool has_promise = false;
+    offset_type offset = 0;
+    size_type size = 0;
+    size_type done = 0;
+#if __FST_ASYNC_FILE_READER_USE_IO_URING
+    iovec iov = {};
+#endif
+  };
+
+  backend_type _backend = backend_type::none;
+  offset_type _file_size = 0;
+  size_type _buffer_size = 0;
+  size_type _buffer_stride = 0;
+  size_type _alignment = 0;
+  value_type* _memory = nullptr;
+
+  // Requests and buffers share the same index.
+  std::vector<request> _requests;
+  std::vector<std::uint32_t> _free_list;
+  size_type _pending = 0;
+  std::mutex _mutex;
+  std::condition_variable _free_cv;
+  std::condition_variable _done_cv;
+
+  // Thread pool.
+  std::vector<std::thread> _threads;
+  std::deque<std::uint32_t> _queue;
+  std::condition_variable _queue_cv;
+  bool _stop = false;
+
+#if __FST_WINDOWS__
+  HANDLE _file = INVALID_HANDLE_VALUE;
+#else
+  int _file = -1;
+#endif
+
+  inline value_type* buffer_data(std::uint32_t index) const noexcept { return _memory + index * _buffer_stride; }
+
+  inline std::uint32_t acquire(offset_type offset, size_type count) {
+    if (!is_open() || count > _buffer_size) {
+      return invalid_index;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _free_cv.wait(lock, [this]() { return !_free_list.empty(); });
+
+    const std::uint32_t index = _free_list.back();
+    _free_list.pop_back();
+    _pending++;
+    lock.unlock();
+
+    request& r = _requests[index];
+    r.offset = offset;
+    r.size = count;
+    r.done = 0;
+    return index;
+  }
+
+  inline void release(std::uint32_t index) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _free_list.push_back(index);
+    }
+
+    _free_cv.notify_one();
+  }
+
+  inline void submit(std::uint32_t index) {
+#if __FST_ASYNC_FILE_READER_USE_IO_URING
+    if (_backend == backend_type::io_uring) {
+      if (const int error = _ring_error.load(std::memory_order_relaxed)) {
+        complete(index, error);
+        return;
+      }
+
+      if (!_ring.submit_read(_file, index, _requests[index], buffer_data(index))) {
+        complete(index, errno ? errno : EIO);
+      }
+      return;
+    }
+#endif
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _queue.push_back(index);
+    }
+
+    _queue_cv.notify_one();
+  }
+
+  /// Hands the buffer to the caller, the request slot stays reserved until the buffer is released.
+  inline void complete(std::uint32_t index, int error) {
+    request& r = _requests[index];
+
+    completion c;
+    c.offset = r.offset;
+    c.error = error;
+    c.data = buffer(this, index, r.done);
+
+    if (r.has_promise) {
+      r.has_promise = false;
+      std::promise<completion> promise = std::move(r.promise);
+      promise.set_value(std::move(c));
+    }
+    else {
+      callback_type fct = std::move(r.callback);
+      r.callback = nullptr;
+      if (fct) {
+        fct(std::move(c));
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (--_pending == 0) {
+      _done_cv.notify_all();
+    }
+  }
+
+  //
+  // MARK: Thread pool.
+  //
+  inline void pool_loop() {
+    for (;;) {
+      std::uint32_t index;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _queue_cv.wait(lock, [this]() { return _stop || !_queue.empty(); });
+
+        if (_queue.empty()) {
+          return;
+        }
+
+        index = _queue.front();
+        _queue.pop_front();
+      }
+
+      request& r = _requests[index];
+      complete(index, read_blocking(buffer_data(index), r.offset, r.size, r.done));
+    }
+  }
+
+  /// Reads until size bytes, the end of the file or an error, returns the error.
+  inline int read_blocking(value_type* data, offset_type offset, size_type size, size_type& done) noexcept {
+    while (done < size) {
+#if __FST_WINDOWS__
+      const offset_type position = offset + done;
+      OVERLAPPED ov = {};
+      ov.Offset = (DWORD)(position & 0xFFFFFFFF);
+      ov.OffsetHigh = (DWORD)(position >> 32);
+
+      DWORD n = 0;
+      const DWORD count = (DWORD)std::min<size_type>(size - done, 1u << 30);
+      if (!ReadFile(_file, data + done, count, &n, &ov)) {
+        const DWORD error = GetLastError();
+        return error == ERROR_HANDLE_EOF ? 0 : (int)error;
+      }
+#else
+      const ssize_t n = ::pread(_file, data + done, size - done, (off_t)(offset + done));
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        return errno;
+      }
+#endif
+
+      if (n == 0) {
+        break;
+      }
+
+      done += (size_type)n;
+    }
+
+    return 0;
+  }
+
+  //
+  // MARK: File.
+  //
+  inline bool open_file(const std::filesystem::path& file_path) {
+#if __FST_WINDOWS__
+    std::filesystem::path w_path = file_path;
+    w_path.make_preferred();
+
+    _file = CreateFileW((LPCWSTR)w_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size)) {
+      close_file();
+      return false;
+    }
+
+    _file_size = (offset_type)size.QuadPart;
+#else
+    _file = ::open(file_path.c_str(), O_RDONLY);
+    if (_file < 0) {
+      return false;
+    }
+
+    struct stat st;
+    if (::fstat(_file, &st) != 0) {
+      close_file();
+      return false;
+    }
+
+    _file_size = (offset_type)st.st_size;
+#endif
+
+    return true;
+  }
+
+  inline void close_file() noexcept {
+#if __FST_WINDOWS__
+    if (_file != INVALID_HANDLE_VALUE) {
+      CloseHandle(_file);
+      _file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (_file >= 0) {
+      ::close(_file);
+      _file = -1;
+    }
+#endif
+
+    _file_size = 0;
+  }
+
+#if __FST_ASYNC_FILE_READER_USE_IO_URING
+  //
+  // MARK: io_uring.
+  //
+  /// Minimal io_uring, the raw system calls and ring layout from <linux/io_uring.h>.
+  class ring {
+  public:
+    inline bool init(unsigned entries) noexcept {
+      io_uring_params params = {};
+      _fd = (int)::syscall(__NR_io_uring_setup, entries, &params);
+      if (_fd < 0) {
+        _fd = -1;
+        return false;
+      }
+
+      _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      _single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (_single_mmap) {
+        _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+      }
+
+      _sq_ptr = ::mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+      if (_sq_ptr == MAP_FAILED) {
+        _sq_ptr = nullptr;
+        release();
+        return false;
+      }
+
+      if (_single_mmap) {
+        _cq_ptr = _sq_ptr;
+      }
+      else {
+        _cq_ptr = ::mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cq_ptr == MAP_FAILED) {
+          _cq_ptr = nullptr;
+          release();
+          return false;
+        }
+      }
+
+      _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      void* sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+      if (sqes == MAP_FAILED) {
+        release();
+        return false;
+      }
+
+      char* sq = (char*)_sq_ptr;
+      char* cq = (char*)_cq_ptr;
+      _sqes = (io_uring_sqe*)sqes;
+      _sq_head = (unsigned*)(sq + params.sq_off.head);
+      _sq_tail = (unsigned*)(sq + params.sq_off.tail);
+      _sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+      _sq_array = (unsigned*)(sq + params.sq_off.array);
+      _cq_head = (unsigned*)(cq + params.cq_off.head);
+      _cq_tail = (unsigned*)(cq + params.cq_off.tail);
+      _cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+      _cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+      return true;
+    }
+
+    inline void release() noexcept {
+      if (_sqes) {
+        ::munmap(_sqes, _sqes_size);
+        _sqes = nullptr;
+      }
+
+      if (_cq_ptr && !_single_mmap) {
+        ::munmap(_cq_ptr, _cq_size);
+      }
+
+      if (_sq_ptr) {
+        ::munmap(_sq_ptr, _sq_size);
+      }
+
+      _sq_ptr = nullptr;
+      _cq_ptr = nullptr;
+
+      if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+      }
+    }
+
+    inline bool submit_read(int file, std::uint32_t index, request& r, value_type* data) noexcept {
+      r.iov.iov_base = data + r.done;
+      r.iov.iov_len = r.size - r.done;
+
+      io_uring_sqe sqe = {};
+      sqe.opcode = IORING_OP_READV;
+      sqe.fd = file;
+      sqe.addr = (std::uint64_t)(std::uintptr_t)&r.iov;
+      sqe.len = 1;
+      sqe.off = r.offset + r.done;
+      sqe.user_data = (std::uint64_t)index + 1;
+      return submit(sqe);
+    }
+
+    inline bool submit_nop() noexcept {
+      io_uring_sqe sqe = {};
+      sqe.opcode = IORING_OP_NOP;
+      sqe.user_data = 0;
+      return submit(sqe);
+    }
+
+    /// Waits for at least one completion, calls fct(user_data, res) for each of them.
+    /// Returns false with errno set when the ring can't be waited on anymore.
+    template <class _Fct>
+    inline bool wait(_Fct&& fct) noexcept {
+      if (::syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR
+          && errno != EAGAIN && errno != EBUSY) {
+        return false;
+      }
+
+      reap(fct);
+      return true;
+    }
+
+    /// Calls fct(user_data, res) for each completion already posted, returns their count.
+    template <class _Fct>
+    inline size_type reap(_Fct&& fct) noexcept {
+      unsigned head = std::atomic_ref<unsigned>(*_cq_head).load(std::memory_order_relaxed);
+      const unsigned tail = std::atomic_ref<unsigned>(*_cq_tail).load(std::memory_order_acquire);
+
+      // The kernel orders a completion after its submission, but that isn't visible to the
+      // memory model. Submissions happen under _submit_mutex, taking it here makes the request
+      // written before each of these submissions visible to this thread.
+      { std::lock_guard<std::mutex> lock(_submit_mutex); }
+
+      const size_type count = tail - head;
+      while (head != tail) {
+        const io_uring_cqe cqe = _cqes[head & _cq_mask];
+        std::atomic_ref<unsigned>(*_cq_head).store(++head, std::memory_order_release);
+        fct(cqe.user_data, cqe.res);
+      }
+
+      return count;
+    }
+
+  private:
+    int _fd = -1;
+    bool _single_mmap = false;
+    void* _sq_ptr = nullptr;
+    void* _cq_ptr = nullptr;
+    size_type _sq_size = 0;
+    size_type _cq_size = 0;
+    size_type _sqes_size = 0;
+    io_uring_sqe* _sqes = nullptr;
+    unsigned* _sq_head = nullptr;
+    unsigned* _sq_tail = nullptr;
+    unsigned* _sq_array = nullptr;
+    unsigned _sq_mask = 0;
+    unsigned* _cq_head = nullptr;
+    unsigned* _cq_tail = nullptr;
+    unsigned _cq_mask = 0;
+    io_uring_cqe* _cqes = nullptr;
+    std::mutex _submit_mutex;
+
+    // At most one sqe per buffer (plus the stop nop) is in flight, the ring is never full.
+    // Without SQPOLL the kernel only consumes sqes in io_uring_enter, which is called here under
+    // the lock. Once the sq head moved past the sqe it will complete, otherwise it's withdrawn
+    // before reporting a failure so that nothing is left in the ring for a request given back.
+    inline bool submit(const io_uring_sqe& sqe) noexcept {
+      std::lock_guard<std::mutex> lock(_submit_mutex);
+
+      const unsigned tail = *_sq_tail;
+      const unsigned slot = tail & _sq_mask;
+      _sqes[slot] = sqe;
+      _sq_array[slot] = slot;
+      std::atomic_ref<unsigned>(*_sq_tail).store(tail + 1, std::memory_order_release);
+
+      for (;;) {
+        const int error = ::syscall(__NR_io_uring_enter, _fd, 1, 0, 0, nullptr, 0) < 0 ? errno : 0;
+
+        if (std::atomic_ref<unsigned>(*_sq_head).load(std::memory_order_acquire) != tail) {
+          return true;
+        }
+
+        if (error == EINTR || error == EAGAIN || error == EBUSY) {
+          continue;
+        }
+
+        std::atomic_ref<unsigned>(*_sq_tail).store(tail, std::memory_order_release);
+        errno = error ? error : EIO;
+        return false;
+      }
+    }
+  };
+
+  ring _ring;
+  std::atomic<int> _ring_error = 0;
+
+  inline void ring_loop() {
+    bool running = true;
+    const auto on_completion = [&](std::uint64_t user_data, int res) {
+      if (user_data == 0) {
+        running = false;
+        return;
+      }
+
+      const std::uint32_t index = (std::uint32_t)(user_data - 1);
+      request& r = _requests[index];
+
+      if (res == -EINTR || res == -EAGAIN) {
+        submit(index);
+        return;
+      }
+
+      if (res < 0) {
+        complete(index, -res);
+        return;
+      }
+
+      r.done += (size_type)res;
+
+      // Short read before the end of the file, read the rest.
+      if (res > 0 && r.done < r.size && r.offset + r.done < _file_size) {
+        submit(index);
+        return;
+      }
+
+      complete(index, 0);
+    };
+
+    while (running) {
+      if (FST_UNLIKELY(!_ring.wait(on_completion))) {
+        break;
+      }
+    }
+
+    if (!running) {
+      return;
+    }
+
+    // The ring can't be waited on anymore. New reads fail right away, the ones the kernel already
+    // took still complete, their completions are polled until close().
+    _ring_error = errno ? errno : EIO;
+
+    while (running) {
+      if (_ring.reap(on_completion)) {
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (_queue_cv.wait_for(lock, std::chrono::milliseconds(1), [this]() { return _stop; })) {
+        return;
+      }
+    }
+  }
+#endif
+};
+} // namespace fst.
@@ -39,11 +39,13 @@
 #include <fst/small_string>
 #include <fst/string>
 #include <fst/print>
+#include <fst/slot_map>
 #include <fstream>
 #include <filesystem>
 #include <string_view>
 #include <cstring>
 #include <map>
+#include <vector>
 
 namespace fst::binary_file {
 inline constexpr std::size_t header_id_size = 4;
@@ -77,12 +79,22 @@ namespace detail {
 /// Loader.
 class loader {
 public:
-  enum class error_type { none, open_file, invalid_header, invalid_header_id, empty_chunk_size, wrong_chunk_size };
+  enum class error_type {
+    none,
+    open_file,
+    invalid_header,
+    invalid_header_id,
+    empty_chunk_size,
+    wrong_chunk_size,
+    missing_chunk,
+    invalid_data
+  };
 
   struct error_info {
     using enum_type = error_type;
-    static constexpr fst::enum_array<const char*, enum_type, enum_type::wrong_chunk_size> array = { { "No error",
-        "open_file", "invalid_header", "invalid_header_id", "empty_chunk_size", "wrong_chunk_size" } };
+    static constexpr fst::enum_array<const char*, enum_type, enum_type::invalid_data> array = { { "No error",
+        "open_file", "invalid_header", "invalid_header_id", "empty_chunk_size", "wrong_chunk_size",
+        "missing_chunk", "invalid_data" } };
   };
 
   using error_t = fst::enum_error<error_info, error_info::enum_type::none>;
@@ -180,6 +192,7 @@ enum class write_error {
   duplicate_name,
   open_file_error,
   write_error,
+  invalid_name,
 };
 
 /// Writer.
@@ -378,4 +391,170 @@ private:
 };
 
 using writer = writer_t<>;
+
+namespace detail {
+  struct slot_map_header {
+    std::uint32_t key_size;
+    std::uint32_t value_size;
+    std::uint32_t slot_count;
+    std::uint32_t value_count;
+    std::uint32_t next_available_slot_index;
+    std::uint32_t last_available_slot_index;
+  };
+
+  inline constexpr std::size_t slot_map_max_name_size = chunk_id_size - 2;
+
+  inline fst::small_string<chunk_id_size> get_slot_map_chunk_name(std::string_view name, char suffix) {
+    fst::small_string<chunk_id_size> chunk_name(name);
+    chunk_name.push_back('.');
+    chunk_name.push_back(suffix);
+    return chunk_name;
+  }
+
+  template <class T>
+  inline T read_element(const void* data, std::size_t index) noexcept {
+    T value;
+    std::memcpy(&value, (const char*)data + index * sizeof(T), sizeof(T));
+    return value;
+  }
+
+  /// Checks that the unaligned slots and reverse map form a valid slot_map: each value has
+  /// its own slot pointing back to it, and the free list goes through all the other slots once.
+  template <class Key>
+  inline bool is_valid_slot_map_state(const void* slots, const void* reverse_map, const slot_map_header& h) {
+    using key_index_type = typename Key::index_type;
+
+    if (h.value_count > h.slot_count || h.next_available_slot_index > h.slot_count
+        || h.last_available_slot_index > h.slot_count
+        || (h.next_available_slot_index == h.slot_count) != (h.last_available_slot_index == h.slot_count)
+        || (h.next_available_slot_index == h.slot_count) != (h.value_count == h.slot_count)) {
+      return false;
+    }
+
+    std::vector<bool> is_used(h.slot_count, false);
+    for (std::uint32_t i = 0; i < h.value_count; i++) {
+      const key_index_type slot_index = read_element<key_index_type>(reverse_map, i);
+      if (slot_index >= h.slot_count || is_used[slot_index]
+          || read_element<Key>(slots, slot_index).get_index() != i) {
+        return false;
+      }
+
+      is_used[slot_index] = true;
+    }
+
+    std::uint32_t slot_index = h.next_available_slot_index;
+    for (std::uint32_t i = h.value_count; i < h.slot_count; i++) {
+      if (is_used[slot_index]) {
+        return false;
+      }
+
+      is_used[slot_index] = true;
+      if (i + 1 == h.slot_count) {
+        return slot_index == h.last_available_slot_index;
+      }
+
+      slot_index = (std::uint32_t)read_element<Key>(slots, slot_index).get_index();
+      if (slot_index >= h.slot_count) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+} // namespace detail.
+
+/// Adds a snapshot of a slot_map to the writer.
+///
+/// The snapshot is made of four chunks: <name>.h (sizes and free list), <name>.s (slots),
+/// <name>.r (reverse map) and <name>.v (values), so the name can't be longer than 6 characters.
+/// The slots, reverse map and values are added with add_chunk_ref, nothing is copied and the map
+/// must stay unchanged until the writer is done writing.
+///
+/// The keys held elsewhere remain valid with the map returned by load_slot_map().
+template <template <class...> class _VectorType, class T, class Key, template <class...> class Container>
+inline typename writer_t<_VectorType>::error_t add_slot_map(
+    writer_t<_VectorType>& w, std::string_view name, const fst::slot_map<T, Key, Container>& map) {
+  static_assert(std::is_trivially_copyable_v<T>, "binary_file::add_slot_map requires a trivially copyable type.");
+  using error_t = typename writer_t<_VectorType>::error_t;
+
+  if (name.empty() || name.size() > detail::slot_map_max_name_size) {
+    return write_error::invalid_name;
+  }
+
+  const auto state = map.get_raw_state();
+  const detail::slot_map_header h{ (std::uint32_t)sizeof(Key), (std::uint32_t)sizeof(T),
+    (std::uint32_t)state.slots.size(), (std::uint32_t)state.values.size(),
+    (std::uint32_t)state.next_available_slot_index, (std::uint32_t)state.last_available_slot_index };
+
+  if (error_t err = w.add_chunk(detail::get_slot_map_chunk_name(name, 'h'), h)) {
+    return err;
+  }
+
+  // Empty chunks are not allowed, an empty container is a missing chunk.
+  if (!state.slots.empty()) {
+    if (error_t err = w.add_chunk_ref(detail::get_slot_map_chunk_name(name, 's'), fst::byte_view(state.slots))) {
+      return err;
+    }
+  }
+
+  if (!state.values.empty()) {
+    if (error_t err
+        = w.add_chunk_ref(detail::get_slot_map_chunk_name(name, 'r'), fst::byte_view(state.reverse_map))) {
+      return err;
+    }
+
+    if (error_t err = w.add_chunk_ref(detail::get_slot_map_chunk_name(name, 'v'), fst::byte_view(state.values))) {
+      return err;
+    }
+  }
+
+  return error_t();
+}
+
+/// The map must outlive the writer, a temporary would be gone before it's written.
+template <template <class...> class _VectorType, class T, class Key, template <class...> class Container>
+typename writer_t<_VectorType>::error_t add_slot_map(
+    writer_t<_VectorType>& w, std::string_view name, fst::slot_map<T, Key, Container>&& map)
+    = delete;
+
+/// Rebuilds a slot_map from a snapshot made with add_slot_map().
+/// Each container is copied in bulk from the loader data (e.g. the mapped file).
+/// Returns invalid_data, leaving the map unchanged, when the slots don't match the values.
+template <class T, class Key, template <class...> class Container>
+inline loader::error_t load_slot_map(const loader& l, std::string_view name, fst::slot_map<T, Key, Container>& map) {
+  using key_index_type = typename Key::index_type;
+
+  if (name.empty() || name.size() > detail::slot_map_max_name_size) {
+    return loader::error_type::missing_chunk;
+  }
+
+  const fst::byte_view h_data = l.get_data(detail::get_slot_map_chunk_name(name, 'h'));
+  if (h_data.size() != sizeof(detail::slot_map_header)) {
+    return h_data.empty() ? loader::error_type::missing_chunk : loader::error_type::wrong_chunk_size;
+  }
+
+  detail::slot_map_header h;
+  std::memcpy(&h, h_data.data(), sizeof(detail::slot_map_header));
+
+  if (h.key_size != sizeof(Key) || h.value_size != sizeof(T)) {
+    return loader::error_type::wrong_chunk_size;
+  }
+
+  const fst::byte_view slots = l.get_data(detail::get_slot_map_chunk_name(name, 's'));
+  const fst::byte_view reverse_map = l.get_data(detail::get_slot_map_chunk_name(name, 'r'));
+  const fst::byte_view values = l.get_data(detail::get_slot_map_chunk_name(name, 'v'));
+
+  if (slots.size() != h.slot_count * sizeof(Key) || reverse_map.size() != h.value_count * sizeof(key_index_type)
+      || values.size() != h.value_count * sizeof(T)) {
+    return loader::error_type::wrong_chunk_size;
+  }
+
+  if (!detail::is_valid_slot_map_state<Key>(slots.data(), reverse_map.data(), h)) {
+    return loader::error_type::invalid_data;
+  }
+
+  map.set_raw_state(slots.data(), h.slot_count, reverse_map.data(), values.data(), h.value_count,
+      (key_index_type)h.next_available_slot_index, (key_index_type)h.last_available_slot_index);
+  return loader::error_t();
+}
 } // namespace fst::binary_file.
@@ -0,0 +1,317 @@
+///
+/// BSD 3-Clause License
+///
+/// Copyright (c) 2021, Alexandre Arsenault
+/// All rights reserved.
+///
+/// Redistribution and use in source and binary forms, with or without
+/// modification, are permitted provided that the following conditions are met:
+///
+/// * Redistributions of source code must retain the above copyright notice, this
+///   list of conditions and the following disclaimer.
+///
+/// * Redistributions in binary form must reproduce the above copyright notice,
+///   this list of conditions and the following disclaimer in the documentation
+///   and/or other materials provided with the distribution.
+///
+/// * Neither the name of the copyright holder nor the names of its
+///   contributors may be used to endorse or promote products derived from
+///   this software without specific prior written permission.
+///
+/// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+/// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+/// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+/// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+/// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+/// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+/// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+/// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+/// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+/// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+/// POSSIBILITY OF SUCH DAMAGE.
+///
+
+#pragma once
+#include <fst/assert>
+#include <fst/slot_map>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+
+
+namespace fst {
+/// concurrent_slot_map
+///
+/// Fixed capacity slot map that can be used from many threads without an external lock.
+///
+/// - find() and contains() are wait-free: every slot holds an atomic version that is checked
+///   before and after the value is copied out (seqlock style), a stale or recycled key fails the check.
+/// - emplace() and erase() are lock-free: free slots are kept in a tagged Treiber stack,
+///   erase() claims a slot with a single compare and swap on its version.
+/// - Each value also holds a position in the dense array used for iteration. erase() gives it back
+///   to a second free stack, so the dense array never grows past the capacity and emplace() only
+///   fails when every slot is in use.
+///
+/// Values are stored as relaxed atomic words inside the slots, so T must be trivially copyable
+/// and find() returns a copy.
+///
+/// The versions are odd when the slot holds a value and even when it is free. The key generation
+/// is the version of the slot when the value was inserted.
+template <class T>
+class concurrent_slot_map {
+public:
+  static_assert(std::is_trivially_copyable_v<T>, "concurrent_slot_map requires a trivially copyable type.");
+
+  using key_type = slot_map_key<std::uint32_t, std::uint32_t>;
+  using mapped_type = T;
+  using value_type = T;
+  using size_type = std::size_t;
+
+  inline concurrent_slot_map(size_type capacity)
+      : _slots(new slot[capacity])
+      , _dense(new std::atomic<std::uint64_t>[capacity])
+      , _free_slots(capacity)
+      , _free_positions(capacity)
+      , _capacity(capacity) {
+    fst_assert(capacity && capacity < (size_type)UINT32_MAX, "concurrent_slot_map : Invalid capacity.");
+
+    for (size_type i = 0; i < capacity; i++) {
+      _slots[i].version.store(0, std::memory_order_relaxed);
+      _slots[i].dense_position.store(0, std::memory_order_relaxed);
+      _dense[i].store(0, std::memory_order_relaxed);
+      _free_slots.next[i].store(i + 1 < capacity ? (std::uint32_t)(i + 2) : 0, std::memory_order_relaxed);
+    }
+
+    _free_slots.head.store(1, std::memory_order_relaxed);
+  }
+
+  concurrent_slot_map(const concurrent_slot_map&) = delete;
+  concurrent_slot_map& operator=(const concurrent_slot_map&) = delete;
+
+  inline size_type capacity() const noexcept { return _capacity; }
+
+  /// Number of values. Only a hint while other threads are writing.
+  inline size_type size() const noexcept { return _size.load(std::memory_order_relaxed); }
+
+  inline bool empty() const noexcept { return size() == 0; }
+
+  /// Returns the key of the new value, or std::nullopt when there is no free slot.
+  inline std::optional<key_type> insert(const T& value) { return emplace(value); }
+
+  template <class... Args>
+  inline std::optional<key_type> emplace(Args&&... args) {
+    const std::uint32_t idx = _free_slots.pop();
+    if (FST_UNLIKELY(idx == invalid_index)) {
+      return std::nullopt;
+    }
+
+    const std::uint32_t pos = acquire_dense_position();
+    slot& s = _slots[idx];
+
+    // Any reader that copies these words must also see that the slot was released.
+    std::atomic_thread_fence(std::memory_order_release);
+    store_value(s, T(std::forward<Args>(args)...));
+
+    // The dense entry is written before the version is published, for_each() skips it until then.
+    // erase() only reads the position once it has seen the version.
+    const std::uint32_t gen = s.version.load(std::memory_order_relaxed) + 1;
+    s.dense_position.store(pos, std::memory_order_relaxed);
+    _dense[pos].store(make_dense_entry(idx, gen), std::memory_order_relaxed);
+    s.version.store(gen, std::memory_order_release);
+    _size.fetch_add(1, std::memory_order_relaxed);
+
+    key_type key;
+    key.set_index(idx);
+    key.set_generation(gen);
+    return key;
+  }
+
+  /// Returns false if the key was already erased.
+  inline bool erase(const key_type& key) {
+    const std::uint32_t idx = key.get_index();
+    if (FST_UNLIKELY(idx >= _capacity || !is_occupied(key.get_generation()))) {
+      return false;
+    }
+
+    slot& s = _slots[idx];
+    std::uint32_t gen = key.get_generation();
+    if (!s.version.compare_exchange_strong(gen, gen + 1, std::memory_order_acq_rel)) {
+      return false;
+    }
+
+    _size.fetch_sub(1, std::memory_order_relaxed);
+
+    // The position goes back before the slot: an emplace() holding a slot always finds a position.
+    const std::uint32_t pos = s.dense_position.load(std::memory_order_relaxed);
+    _dense[pos].store(0, std::memory_order_relaxed);
+    _free_positions.push(pos);
+    _free_slots.push(idx);
+    return true;
+  }
+
+  /// Wait-free lookup.
+  inline std::optional<T> find(const key_type& key) const {
+    const std::uint32_t idx = key.get_index();
+    if (FST_UNLIKELY(idx >= _capacity)) {
+      return std::nullopt;
+    }
+
+    return load_value(_slots[idx], key.get_generation());
+  }
+
+  inline bool contains(const key_type& key) const {
+    const std::uint32_t idx = key.get_index();
+    return idx < _capacity && is_occupied(key.get_generation())
+        && _slots[idx].version.load(std::memory_order_acquire) == key.get_generation();
+  }
+
+  /// Calls fn(key, value) for each value of the dense array.
+  /// Values inserted or erased during the iteration may or may not be visited.
+  template <class Fn>
+  inline void for_each(Fn&& fn) const {
+    const size_type dsize = dense_size();
+
+    for (size_type i = 0; i < dsize; i++) {
+      const std::uint64_t entry = _dense[i].load(std::memory_order_acquire);
+      if (!entry) {
+        continue;
+      }
+
+      key_type key;
+      key.set_index(get_dense_index(entry));
+      key.set_generation(get_dense_generation(entry));
+
+      if (std::optional<T> value = load_value(_slots[key.get_index()], key.get_generation())) {
+        fn(key, *value);
+      }
+    }
+  }
+
+  /// Number of dense positions used so far, including the ones given back by erase().
+  /// It never exceeds the capacity.
+  inline size_type dense_size() const noexcept { return _dense_size.load(std::memory_order_acquire); }
+
+private:
+  static constexpr std::uint32_t invalid_index = UINT32_MAX;
+  static constexpr size_type word_count = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+  struct slot {
+    std::atomic<std::uint32_t> version;
+    std::atomic<std::uint32_t> dense_position;
+    std::atomic<std::uint64_t> words[word_count];
+  };
+
+  /// Tagged Treiber stack of indices.
+  class free_list {
+  public:
+    inline free_list(size_type capacity)
+        : next(new std::atomic<std::uint32_t>[capacity]) {}
+
+    inline std::uint32_t pop() noexcept {
+      std::uint64_t h = head.load(std::memory_order_acquire);
+
+      while (h & UINT32_MAX) {
+        const std::uint32_t idx = (std::uint32_t)(h & UINT32_MAX) - 1;
+        const std::uint64_t n = next[idx].load(std::memory_order_relaxed);
+        const std::uint64_t new_head = ((h >> 32) + 1) << 32 | n;
+
+        if (head.compare_exchange_weak(h, new_head, std::memory_order_acq_rel, std::memory_order_acquire)) {
+          return idx;
+        }
+      }
+
+      return invalid_index;
+    }
+
+    inline void push(std::uint32_t idx) noexcept {
+      std::uint64_t h = head.load(std::memory_order_relaxed);
+      std::uint64_t new_head;
+
+      do {
+        next[idx].store((std::uint32_t)(h & UINT32_MAX), std::memory_order_relaxed);
+        new_head = ((h >> 32) + 1) << 32 | (std::uint64_t)(idx + 1);
+      } while (!head.compare_exchange_weak(h, new_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Link of each index, index + 1 of the next one (0 for the last one).
+    std::unique_ptr<std::atomic<std::uint32_t>[]> next;
+
+    // Low 32 bits are the index + 1 (0 when empty), high 32 bits are an ABA tag.
+    std::atomic<std::uint64_t> head = 0;
+  };
+
+  std::unique_ptr<slot[]> _slots;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> _dense;
+  free_list _free_slots;
+  free_list _free_positions;
+  size_type _capacity;
+  std::atomic<size_type> _dense_size = 0;
+  std::atomic<size_type> _size = 0;
+
+  static inline bool is_occupied(std::uint32_t version) noexcept { return version & 1; }
+
+  static inline std::uint64_t make_dense_entry(std::uint32_t idx, std::uint32_t gen) noexcept {
+    return ((std::uint64_t)gen << 32) | (std::uint64_t)(idx + 1);
+  }
+
+  static inline std::uint32_t get_dense_index(std::uint64_t entry) noexcept {
+    return (std::uint32_t)(entry & UINT32_MAX) - 1;
+  }
+
+  static inline std::uint32_t get_dense_generation(std::uint64_t entry) noexcept { return (std::uint32_t)(entry >> 32); }
+
+  /// There are never more positions in use than slots, the caller holds a slot so one is
+  /// either free or about to be given back by an erase() in progress.
+  inline std::uint32_t acquire_dense_position() noexcept {
+    for (;;) {
+      const std::uint32_t pos = _free_positions.pop();
+      if (pos != invalid_index) {
+        return pos;
+      }
+
+      size_type dsize = _dense_size.load(std::memory_order_relaxed);
+      while (dsize < _capacity) {
+        if (_dense_size.compare_exchange_weak(dsize, dsize + 1, std::memory_order_release, std::memory_order_relaxed)) {
+          return (std::uint32_t)dsize;
+        }
+      }
+
+      FST_NOP();
+    }
+  }
+
+  static inline void store_value(slot& s, const T& value) noexcept {
+    std::uint64_t words[word_count] = {};
+    std::memcpy(words, &value, sizeof(T));
+
+    for (size_type i = 0; i < word_count; i++) {
+      s.words[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  static inline std::optional<T> load_value(const slot& s, std::uint32_t gen) noexcept {
+    if (!is_occupied(gen) || s.version.load(std::memory_order_acquire) != gen) {
+      return std::nullopt;
+    }
+
+    std::uint64_t words[word_count];
+    for (size_type i = 0; i < word_count; i++) {
+      words[i] = s.words[i].load(std::memory_order_relaxed);
+    }
+
+    // The words were rewritten if the slot was released in the meantime.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.version.load(std::memory_order_relaxed) != gen) {
+      return std::nullopt;
+    }
+
+    alignas(T) unsigned char buffer[sizeof(T)];
+    std::memcpy(buffer, words, sizeof(T));
+    return *std::launder(reinterpret_cast<T*>(buffer));
+  }
+};
+} // namespace fst.
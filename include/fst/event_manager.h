@@ -30,29 +30,60 @@
 /// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 /// POSSIBILITY OF SUCH DAMAGE.
 ///
-
 #pragma once
-#include <fst/spin_lock>
-#include <fst/fixed_unordered_set>
-#include <fst/fixed_vector>
+#include <fst/assert>
+#include <fst/inplace_function>
 #include <fst/pointer>
+#include <fst/slot_map>
 #include <fst/traits>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <thread>
-#include <functional>
+#include <vector>
 
 namespace fst {
+/// event_manager
+///
+/// Runs one-shot and recurrent callbacks on an internal thread.
+///
+/// Deadlines are kept in a hierarchical timer wheel (4 levels of 64 slots) with a resolution of
+/// get_delta_time() milliseconds. Adding and removing an event is O(1), and the thread sleeps
+/// on a condition variable until the next deadline instead of polling.
+///
+/// The tick based functions are kept for compatibility, a tick is one resolution step.
+///
+/// Events are stored in a slot_map, there is no limit on the number of events and callbacks
+/// are stored inline (up to callback_capacity bytes) without any heap allocation.
+///
+/// Callbacks never run while the registry is locked. The due events are collected under the lock,
+/// then run inline on the event thread or dispatched to a pool of workers (see init()).
+/// An event is never run concurrently with itself, and once remove_event() returns, its callback
+/// is not running and won't be called again (unless remove_event() is called from the callback itself).
+/// When remove_event() is called from any callback while the event runs on another thread, it doesn't
+/// wait: two callbacks removing each other's event would deadlock. The event won't be called again,
+/// but its callback may still be running when remove_event() returns.
 class event_manager {
 public:
-  static constexpr std::size_t maximum_events_count = 64;
+  static constexpr std::size_t callback_capacity = 64;
+  using callback_type = fst::inplace_function<void(), callback_capacity>;
   using idle_ms_type = std::chrono::milliseconds::rep;
   static constexpr idle_ms_type default_idle_ms = 5;
   static constexpr idle_ms_type minimum_idle_ms = 1;
   static constexpr idle_ms_type maximum_idle_ms = 500;
+  using clock_type = std::chrono::steady_clock;
+  using duration = clock_type::duration;
   enum class event_id : std::size_t {};
   static constexpr event_id invalid_id = (event_id)std::numeric_limits<std::size_t>::max();
+  static constexpr std::size_t any_worker = std::numeric_limits<std::size_t>::max();
 
   class disconnector {
   public:
@@ -111,122 +142,583 @@ public:
   inline event_manager() = default;
   inline ~event_manager() { stop(); }
 
-  inline void init(idle_ms_type delta_time_ms = default_idle_ms) {
+  /// Starts the event thread.
+  /// @param worker_count When 0, the callbacks are called on the event thread. Otherwise they are
+  ///                     dispatched to worker_count threads, see set_event_affinity().
+  inline void init(idle_ms_type delta_time_ms = default_idle_ms, std::size_t worker_count = 0) {
     stop();
     _delta_time_ms = std::chrono::milliseconds(std::clamp(delta_time_ms, minimum_idle_ms, maximum_idle_ms));
+    _scheduler.set_resolution(_delta_time_ms);
+    _scheduler.start_workers(worker_count);
     _stopper.start();
     _idle_thread = std::thread(&event_manager::idle_thread, std::ref(*this));
   }
 
   inline idle_ms_type get_delta_time() const { return _delta_time_ms.count(); }
+  inline std::size_t get_worker_count() const { return _scheduler.get_worker_count(); }
 
-  inline event_id add_event(const std::function<void()>& fct) { return (event_id)_event_stack.add(fct, 0, 0, false); }
+  inline event_id add_event(const callback_type& fct) { return add_event(fct, 0, 0, false); }
 
-  inline event_id add_recurrent_event(const std::function<void()>& fct, std::size_t tick_count = 0) {
-    return (event_id)_event_stack.add(fct, tick_count, tick_count, true);
+  inline event_id add_recurrent_event(const callback_type& fct, std::size_t tick_count = 0) {
+    return add_event(fct, tick_count, tick_count, true);
   }
 
   inline event_id add_recurrent_event(
-      const std::function<void()>& fct, std::size_t tick_count, std::size_t init_tick_count) {
-    return (event_id)_event_stack.add(fct, tick_count, init_tick_count, true);
+      const callback_type& fct, std::size_t tick_count, std::size_t init_tick_count) {
+    return add_event(fct, tick_count, init_tick_count, true);
   }
 
+  /// The first call happens after tick_count - init_tick_count ticks,
+  /// recurrent events are then called every tick_count ticks.
   inline event_id add_event(
-      const std::function<void()>& fct, std::size_t tick_count, std::size_t init_tick_count, bool is_recurrent) {
-    return (event_id)_event_stack.add(fct, tick_count, init_tick_count, is_recurrent);
+      const callback_type& fct, std::size_t tick_count, std::size_t init_tick_count, bool is_recurrent) {
+    const std::size_t first_tick_count = tick_count > init_tick_count ? tick_count - init_tick_count : 1;
+    return (event_id)_scheduler.add(fct, (idle_ms_type)(first_tick_count - 1) * _delta_time_ms,
+        (idle_ms_type)std::max<std::size_t>(tick_count, 1) * _delta_time_ms, is_recurrent);
   }
 
-  inline bool remove_event(event_id __id) { return _event_stack.remove((std::size_t)__id); }
-  inline bool is_connected(event_id __id) const { return _event_stack.is_connected((std::size_t)__id); }
+  /// Calls fct once, after delay.
+  inline event_id add_delayed_event(const callback_type& fct, duration delay) {
+    return (event_id)_scheduler.add(fct, delay, duration::zero(), false);
+  }
+
+  /// Calls fct every period, starting after one period.
+  inline event_id add_periodic_event(const callback_type& fct, duration period) {
+    return add_periodic_event(fct, period, period);
+  }
+
+  inline event_id add_periodic_event(const callback_type& fct, duration period, duration initial_delay) {
+    fst_assert(period > duration::zero(), "event_manager::add_periodic_event : period must be greater than zero.");
+    return (event_id)_scheduler.add(fct, initial_delay, period, true);
+  }
+
+  inline bool remove_event(event_id __id) { return _scheduler.remove((std::size_t)__id); }
+  inline bool is_connected(event_id __id) const { return _scheduler.is_connected((std::size_t)__id); }
+
+  /// Runs the event on the worker at worker_index (modulo the worker count).
+  /// Events default to any_worker, which spreads them round-robin.
+  /// Events that share a worker never run concurrently and run in deadline order.
+  inline bool set_event_affinity(event_id __id, std::size_t worker_index) {
+    return _scheduler.set_affinity((std::size_t)__id, worker_index);
+  }
+
+  inline std::size_t size() const { return _scheduler.size(); }
+  inline void reserve(std::size_t count) { _scheduler.reserve(count); }
 
 private:
-  class event_stack {
+  /// Hierarchical timer wheel.
+  ///
+  /// Level l has 64 slots of 64^l ticks. An event is linked in the slot of the level that covers
+  /// its distance to the current tick. When the lower level wraps, the matching slot of the level above
+  /// is cascaded down. Non-empty slots are tracked in one bitmap per level, so the next deadline is
+  /// found with a few countr_zero.
+  ///
+  /// Events are stored in a slot_map, an event id is the slot_map key. The wheel lists link
+  /// the events by slot index, which is stable for the lifetime of an event.
+  class scheduler {
   public:
-    struct event_data {
-      std::function<void()> callback;
-      std::size_t id = 0;
-      std::size_t count;
-      std::size_t counter;
-      bool is_recurrent;
-    };
+    inline scheduler() noexcept { _heads.fill(nil); }
+
+    inline ~scheduler() { stop_workers(); }
+
+    inline std::size_t add(const callback_type& fct, duration delay, duration period, bool is_recurrent) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      const key_type key = _events.emplace();
+
+      event_data& evt = get(key.get_index());
+      evt.callback = fct;
+      evt.deadline = clock_type::now() + std::max(delay, duration::zero());
+      evt.period = period;
+      evt.is_recurrent = is_recurrent;
+      evt.key = key;
+      link(key.get_index(), get_tick(evt.deadline));
+
+      const std::size_t id = make_id(key);
+      const bool should_wake = evt.expire_tick < _wake_tick;
+      lock.unlock();
 
-    using vector_type = fst::stack_fixed_vector<event_data, maximum_events_count>;
+      if (should_wake) {
+        _cv.notify_one();
+      }
 
-    inline std::size_t add(
-        const std::function<void()>& fct, std::size_t tick_count, std::size_t init_tick_count, bool is_recurrent) {
-      fst::scoped_spin_lock lock(_lock);
-      _id_counter++;
-      std::size_t id = _id_counter;
-      _data.push_back({ fct, id, init_tick_count, tick_count, is_recurrent });
       return id;
     }
 
     inline bool remove(std::size_t id) {
-      fst::scoped_spin_lock lock(_lock);
-      for (std::size_t i = 0; i < _data.size(); i++) {
-        if (_data[i].id == id) {
-          _data.erase(i);
-          //          _data.erase(_data.begin() + i);
+      std::unique_lock<std::mutex> lock(_mutex);
+      const key_type key = get_key(id);
+      auto it = _events.find(key);
+
+      // Wait for the callback to return, unless it's the callback removing itself.
+      const std::thread::id this_id = std::this_thread::get_id();
+      while (it != _events.end() && it->running_thread != std::thread::id() && it->running_thread != this_id) {
+        // From a callback, the event is only marked removed, it's erased once its callback returns.
+        if (_callback_depth) {
+          if (it->is_removed) {
+            return false;
+          }
+
+          unlink(key.get_index());
+          it->is_removed = true;
           return true;
         }
+
+        _remove_waiter_count++;
+        _done_cv.wait(lock);
+        _remove_waiter_count--;
+        it = _events.find(key);
+      }
+
+      if (it == _events.end() || it->is_removed) {
+        return false;
       }
 
-      return false;
+      unlink(key.get_index());
+      _events.erase(it);
+      return true;
     }
 
-    inline bool is_connected(std::size_t __id) const {
-      fst::scoped_spin_lock lock(_lock);
-      for (const event_data& evt_data : _data) {
-        if (evt_data.id == __id) {
-          return true;
+    inline bool set_affinity(std::size_t id, std::size_t worker_index) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _events.find(get_key(id));
+      if (it == _events.end()) {
+        return false;
+      }
+
+      it->affinity = worker_index == any_worker ? nil : (std::uint32_t)worker_index;
+      return true;
+    }
+
+    inline bool is_connected(std::size_t id) const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _events.find(get_key(id));
+      return it != _events.end() && !it->is_removed;
+    }
+
+    inline std::size_t size() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _events.size();
+    }
+
+    inline void reserve(std::size_t count) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _events.reserve(count);
+    }
+
+    /// Re-bases the wheel, all events keep their deadlines.
+    inline void set_resolution(duration resolution) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _heads.fill(nil);
+      _bitmaps.fill(0);
+      _resolution = resolution;
+      _start = clock_type::now();
+      _current_tick = 0;
+
+      // One-shot events waiting to be run are not in the wheel anymore.
+      for (event_data& evt : _events) {
+        if (evt.list_index != nil) {
+          link(evt.key.get_index(), get_tick(evt.deadline));
         }
       }
+    }
+
+    inline void start_workers(std::size_t worker_count) {
+      stop_workers();
 
-      return false;
+      for (std::size_t i = 0; i < worker_count; i++) {
+        _workers.push_back(std::make_unique<worker>(*this));
+      }
     }
 
-    inline void execute() {
-      _lock.lock();
-      for (auto& f : _data) {
-        if (++f.count >= f.counter) {
-          f.callback();
-          f.count = 0;
+    /// Waits for the queued events to be run.
+    inline void stop_workers() {
+      for (auto& w : _workers) {
+        w->stop();
+      }
 
-          if (!f.is_recurrent) {
-            _ids_to_remove.push_back(f.id);
-          }
+      _workers.clear();
+    }
+
+    inline std::size_t get_worker_count() const noexcept { return _workers.size(); }
+
+    /// Runs the due events and sleeps until the next deadline, as long as is_running() returns true.
+    template <class _Fct>
+    inline void run(_Fct&& is_running) {
+      std::vector<key_type> due_events;
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      while (is_running()) {
+        advance(get_tick(clock_type::now(), false), due_events);
+
+        if (!due_events.empty()) {
+          lock.unlock();
+          dispatch(due_events);
+          due_events.clear();
+          lock.lock();
+          continue;
         }
+
+        _wake_tick = get_next_tick();
+        if (_wake_tick == no_tick) {
+          _cv.wait(lock);
+        }
+        else {
+          _cv.wait_until(lock, _start + _wake_tick * _resolution);
+        }
+
+        _wake_tick = 0;
       }
-      _lock.unlock();
+    }
+
+    /// Wakes up run(), e.g. to let it check is_running().
+    inline void wake() {
+      { std::lock_guard<std::mutex> lock(_mutex); }
+      _cv.notify_all();
+    }
+
+  private:
+    static constexpr std::uint32_t nil = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::uint64_t no_tick = std::numeric_limits<std::uint64_t>::max();
+    static constexpr std::size_t level_count = 4;
+    static constexpr std::size_t slot_bits = 6;
+    static constexpr std::size_t slot_count = 1 << slot_bits;
+    static constexpr std::uint64_t slot_mask = slot_count - 1;
+
+    using key_type = fst::slot_map_key<std::uint32_t, std::uint32_t>;
+
+    struct event_data {
+      callback_type callback;
+      clock_type::time_point deadline;
+      duration period;
+      bool is_recurrent = false;
+
+      // Set when the event is collected, cleared once its callback returns.
+      bool is_queued = false;
+      std::thread::id running_thread;
+
+      // Removed from another callback while running, erased once its callback returns.
+      bool is_removed = false;
+      std::uint32_t affinity = nil;
+
+      key_type key = {};
+      std::uint64_t expire_tick = 0;
+      std::uint32_t prev = nil;
+      std::uint32_t next = nil;
+
+      // nil when the event is not linked in the wheel.
+      std::uint32_t list_index = nil;
+    };
+
+    using event_map = fst::slot_map<event_data, key_type>;
+
+    /// Runs the events pushed by the event thread, in order.
+    class worker {
+    public:
+      inline worker(scheduler& s)
+          : _scheduler(s)
+          , _thread(&worker::run, this) {}
 
-      _lock.lock();
-      if (_ids_to_remove.size()) {
-        std::size_t r_index = 0;
-        for (auto it = _data.begin(); it != _data.end() && r_index < _ids_to_remove.size();) {
-          if (it->id == _ids_to_remove[r_index]) {
-            _data.erase(it);
-            r_index++;
+      inline void push(const key_type& key) {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _queue.push_back(key);
+        }
+        _cv.notify_one();
+      }
+
+      inline void stop() {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _is_stopping = true;
+        }
+        _cv.notify_one();
+
+        if (_thread.joinable()) {
+          _thread.join();
+        }
+      }
+
+    private:
+      scheduler& _scheduler;
+      std::mutex _mutex;
+      std::condition_variable _cv;
+      std::vector<key_type> _queue;
+      bool _is_stopping = false;
+      std::thread _thread;
+
+      inline void run() {
+        std::vector<key_type> keys;
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (true) {
+          _cv.wait(lock, [this]() { return _is_stopping || !_queue.empty(); });
+          if (_queue.empty()) {
+            return;
           }
-          else {
-            ++it;
+
+          keys.swap(_queue);
+          lock.unlock();
+
+          for (const key_type& key : keys) {
+            _scheduler.execute(key);
           }
+
+          keys.clear();
+          lock.lock();
         }
+      }
+    };
+
+    event_map _events;
+    std::array<std::uint32_t, level_count * slot_count> _heads;
+    std::array<std::uint64_t, level_count> _bitmaps = {};
+
+    clock_type::time_point _start = clock_type::now();
+    duration _resolution = std::chrono::milliseconds(default_idle_ms);
+    std::uint64_t _current_tick = 0;
+    std::uint64_t _wake_tick = 0;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    std::condition_variable _done_cv;
+    std::size_t _remove_waiter_count = 0;
+
+    // Number of callbacks running on this thread, of any scheduler.
+    static inline thread_local std::size_t _callback_depth = 0;
+
+    std::vector<std::unique_ptr<worker>> _workers;
+    std::size_t _next_worker = 0;
+
+    static inline std::size_t make_id(const key_type& key) noexcept {
+      return ((std::size_t)key.get_generation() << 32) | key.get_index();
+    }
 
-        _ids_to_remove.clear();
+    static inline key_type get_key(std::size_t id) noexcept {
+      return key_type{ (std::uint32_t)(id & 0xFFFFFFFF), (std::uint32_t)(id >> 32) };
+    }
+
+    /// Event of a live slot index.
+    inline event_data& get(std::uint32_t index) noexcept { return *_events.find_unchecked(key_type{ index, 0 }); }
+
+    /// Runs the callback of a collected event without holding the lock.
+    inline void execute(const key_type& key) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto it = _events.find(key);
+      if (it == _events.end()) {
+        return;
+      }
+
+      it->running_thread = std::this_thread::get_id();
+      callback_type callback = it->callback;
+      lock.unlock();
+
+      _callback_depth++;
+      callback();
+      _callback_depth--;
+
+      lock.lock();
+      it = _events.find(key);
+      if (it != _events.end()) {
+        it->running_thread = std::thread::id();
+        it->is_queued = false;
+
+        if (!it->is_recurrent || it->is_removed) {
+          _events.erase(it);
+        }
+      }
+
+      if (_remove_waiter_count) {
+        _done_cv.notify_all();
       }
-      _lock.unlock();
     }
 
-    inline void clear() {
-      fst::scoped_spin_lock lock(_lock);
-      _data.clear();
+    inline void dispatch(const std::vector<key_type>& keys) {
+      if (_workers.empty()) {
+        for (const key_type& key : keys) {
+          execute(key);
+        }
+
+        return;
+      }
+
+      for (const key_type& key : keys) {
+        std::uint32_t affinity;
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          auto it = _events.find(key);
+          if (it == _events.end()) {
+            continue;
+          }
+
+          affinity = it->affinity;
+        }
+
+        const std::size_t worker_index = affinity == nil ? _next_worker++ : affinity;
+        _workers[worker_index % _workers.size()]->push(key);
+      }
     }
 
-  private:
-    vector_type _data;
-    fst::unordered_array<std::size_t, maximum_events_count> _ids_to_remove;
-    mutable fst::spin_lock_mutex _lock;
-    std::size_t _id_counter = 0;
+    /// First tick at or after the time point (or the last tick before it when round_up is false).
+    inline std::uint64_t get_tick(clock_type::time_point tp, bool round_up = true) const noexcept {
+      if (tp <= _start) {
+        return 0;
+      }
+
+      const auto elapsed = (std::uint64_t)(tp - _start).count();
+      const auto res = (std::uint64_t)_resolution.count();
+      return round_up ? (elapsed + res - 1) / res : elapsed / res;
+    }
+
+    static inline constexpr std::size_t level_shift(std::size_t level) noexcept { return level * slot_bits; }
+
+    inline void link(std::uint32_t index, std::uint64_t tick) {
+      event_data& evt = get(index);
+      evt.expire_tick = std::max(tick, _current_tick);
+
+      const std::uint64_t delta = evt.expire_tick - _current_tick;
+      std::size_t level = 0;
+      while (level < level_count - 1 && delta >= (std::uint64_t(1) << level_shift(level + 1))) {
+        level++;
+      }
+
+      std::size_t slot;
+      if (delta >= (std::uint64_t(1) << level_shift(level_count))) {
+        // Too far, park it in the last slot of the top level, it gets re-linked when cascaded.
+        slot = ((_current_tick >> level_shift(level)) + slot_mask) & slot_mask;
+      }
+      else {
+        slot = (evt.expire_tick >> level_shift(level)) & slot_mask;
+      }
+
+      const std::uint32_t list_index = (std::uint32_t)(level * slot_count + slot);
+      evt.list_index = list_index;
+      evt.prev = nil;
+      evt.next = _heads[list_index];
+
+      if (evt.next != nil) {
+        get(evt.next).prev = index;
+      }
+
+      _heads[list_index] = index;
+      _bitmaps[level] |= std::uint64_t(1) << slot;
+    }
+
+    inline void unlink(std::uint32_t index) {
+      event_data& evt = get(index);
+      if (evt.list_index == nil) {
+        return;
+      }
+
+      if (evt.prev != nil) {
+        get(evt.prev).next = evt.next;
+      }
+      else {
+        _heads[evt.list_index] = evt.next;
+      }
+
+      if (evt.next != nil) {
+        get(evt.next).prev = evt.prev;
+      }
+
+      if (_heads[evt.list_index] == nil) {
+        _bitmaps[evt.list_index / slot_count] &= ~(std::uint64_t(1) << (evt.list_index % slot_count));
+      }
+
+      evt.list_index = nil;
+    }
+
+    /// Detaches the whole list of a slot.
+    inline std::uint32_t take_slot(std::size_t level, std::size_t slot) {
+      const std::size_t list_index = level * slot_count + slot;
+      const std::uint32_t head = _heads[list_index];
+      _heads[list_index] = nil;
+      _bitmaps[level] &= ~(std::uint64_t(1) << slot);
+      return head;
+    }
+
+    /// First tick at or after _current_tick where a non-empty slot is cascaded or run.
+    inline std::uint64_t get_next_tick() const noexcept {
+      std::uint64_t next_tick = no_tick;
+
+      for (std::size_t level = 0; level < level_count; level++) {
+        const std::uint64_t bitmap = _bitmaps[level];
+        if (!bitmap) {
+          continue;
+        }
+
+        const std::size_t shift = level_shift(level);
+        const std::size_t wheel_shift = level_shift(level + 1);
+        const std::uint64_t base = (_current_tick >> wheel_shift) << wheel_shift;
+
+        // Smallest slot whose start tick is not behind _current_tick.
+        const std::uint64_t first_slot = ((_current_tick - base) + (std::uint64_t(1) << shift) - 1) >> shift;
+        const std::uint64_t ahead = first_slot < slot_count ? bitmap & (~std::uint64_t(0) << first_slot) : 0;
+
+        const std::uint64_t tick = ahead ? base + ((std::uint64_t)std::countr_zero(ahead) << shift)
+                                         : base + (std::uint64_t(1) << wheel_shift)
+                + ((std::uint64_t)std::countr_zero(bitmap) << shift);
+
+        next_tick = std::min(next_tick, tick);
+      }
+
+      return next_tick;
+    }
+
+    inline void advance(std::uint64_t now_tick, std::vector<key_type>& due_events) {
+      while (_current_tick <= now_tick) {
+        const std::uint64_t next_tick = get_next_tick();
+        if (next_tick > now_tick) {
+          _current_tick = now_tick + 1;
+          return;
+        }
+
+        _current_tick = next_tick;
+        run_tick(_current_tick, due_events);
+        _current_tick++;
+      }
+    }
+
+    /// Cascades the wheel and collects the events of the tick.
+    inline void run_tick(std::uint64_t tick, std::vector<key_type>& due_events) {
+      // Cascade the upper levels that wrap on this tick, top level first.
+      for (std::size_t level = level_count - 1; level > 0; level--) {
+        if (tick & ((std::uint64_t(1) << level_shift(level)) - 1)) {
+          continue;
+        }
+
+        std::uint32_t index = take_slot(level, (tick >> level_shift(level)) & slot_mask);
+        while (index != nil) {
+          const std::uint32_t next = get(index).next;
+          link(index, get(index).expire_tick);
+          index = next;
+        }
+      }
+
+      std::uint32_t index = take_slot(0, tick & slot_mask);
+      while (index != nil) {
+        event_data& evt = get(index);
+        const std::uint32_t next = evt.next;
+        evt.list_index = nil;
+
+        // A recurrent event still running from its previous deadline skips this one.
+        if (!evt.is_queued) {
+          evt.is_queued = true;
+          due_events.push_back(evt.key);
+        }
+
+        if (evt.is_recurrent) {
+          const clock_type::time_point now = clock_type::now();
+          evt.deadline += evt.period;
+          if (evt.deadline <= now) {
+            evt.deadline = now + evt.period;
+          }
+
+          link(index, std::max(get_tick(evt.deadline), tick + 1));
+        }
+
+        index = next;
+      }
+    }
   };
 
   class thread_stopper {
@@ -256,22 +748,21 @@ private:
     _stopper.stop();
 
     if (_idle_thread.joinable()) {
+      _scheduler.wake();
       _idle_thread.join();
     }
+
+    _scheduler.stop_workers();
   }
 
   static int idle_thread(event_manager& em) {
-    while (em._stopper) {
-      em._event_stack.execute();
-      std::this_thread::sleep_for(em._delta_time_ms);
-    }
-
+    em._scheduler.run([&em]() { return (bool)em._stopper; });
     return 0;
   }
 
-  event_stack _event_stack;
+  scheduler _scheduler;
   thread_stopper _stopper;
   std::thread _idle_thread;
-  std::chrono::milliseconds _delta_time_ms;
+  std::chrono::milliseconds _delta_time_ms = std::chrono::milliseconds(default_idle_ms);
 };
 } // namespace fst.
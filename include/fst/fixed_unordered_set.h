@@ -33,11 +33,12 @@
 
 #pragma once
 #include <fst/assert>
-#include <fst/spin_lock>
 #include <fst/unordered_array>
 #include <fst/enum_array>
 #include <array>
 #include <atomic>
+#include <bit>
+#include <cstdint>
 #include <initializer_list>
 
 namespace fst {
@@ -187,13 +188,21 @@ private:
   std::array<bool, maximum_size> _is_in_array;
 };
 
+/// lock_free_fixed_unordered_set
+///
+/// Set of small integral values in [0, _Size) that can be shared between threads without locks.
+///
+/// Membership is an atomic bitset, every operation is wait-free: insert(), erase() and contains()
+/// touch a single word, get_content_and_clear() swaps each word with zero and decodes the bits
+/// it took. A value inserted during a get_content_and_clear() ends up in this batch or in the
+/// next one, never in both and never lost. Multi-word reads (size(), get_content()) are not a
+/// snapshot of the whole set.
+///
+/// Content is always returned in ascending order.
 template <typename _T, std::size_t _Size>
 class lock_free_fixed_unordered_set {
 public:
   using value_type = _T;
-  using const_reference = const value_type&;
-  using const_pointer = const value_type*;
-  using const_iterator = const_pointer;
   using size_type = std::size_t;
   using difference_type = std::ptrdiff_t;
   static constexpr size_type maximum_size = _Size;
@@ -202,73 +211,86 @@ public:
 
   static_assert(std::is_integral<value_type>::value, "Integral type required.");
 
-  inline lock_free_fixed_unordered_set() { _is_in_array.fill(false); }
+  inline lock_free_fixed_unordered_set() noexcept = default;
 
-  inline void insert(value_type value) {
-    fst_assert(value < maximum_size, "lock_free_fixed_unordered_set::insert Out of bound value.");
-
-    scoped_spin_lock lock(_mutex);
-    if (_is_in_array[value]) {
-      return;
-    }
+  lock_free_fixed_unordered_set(const lock_free_fixed_unordered_set&) = delete;
+  lock_free_fixed_unordered_set& operator=(const lock_free_fixed_unordered_set&) = delete;
 
-    _array.push_back(value);
-    _is_in_array[value] = true;
+  inline void insert(value_type value) noexcept {
+    fst_assert((size_type)value < maximum_size, "lock_free_fixed_unordered_set::insert Out of bound value.");
+    _words[word_index(value)].fetch_or(word_mask(value), std::memory_order_release);
   }
 
-  inline void erase(value_type value) {
-    fst_assert(value < maximum_size, "lock_free_fixed_unordered_set::erase Out of bound value.");
-
-    scoped_spin_lock lock(_mutex);
-    if (!_is_in_array[value]) {
-      return;
-    }
-
-    _is_in_array[value] = false;
-    _array.erase_first_if([value](value_type v) { return v == value; });
+  inline void erase(value_type value) noexcept {
+    fst_assert((size_type)value < maximum_size, "lock_free_fixed_unordered_set::erase Out of bound value.");
+    _words[word_index(value)].fetch_and(~word_mask(value), std::memory_order_release);
   }
 
-  inline bool contains(value_type value) const {
-    fst_assert(value < maximum_size, "lock_free_fixed_unordered_set::contains Out of bound value.");
-
-    scoped_spin_lock lock(_mutex);
-    return _is_in_array[value];
+  inline bool contains(value_type value) const noexcept {
+    fst_assert((size_type)value < maximum_size, "lock_free_fixed_unordered_set::contains Out of bound value.");
+    return _words[word_index(value)].load(std::memory_order_acquire) & word_mask(value);
   }
 
   inline void clear() noexcept {
-    scoped_spin_lock lock(_mutex);
-    _is_in_array.fill(false);
-    _array.clear();
+    for (std::atomic<word_type>& w : _words) {
+      w.store(0, std::memory_order_release);
+    }
   }
 
   inline array_type get_content_and_clear() noexcept {
-    scoped_spin_lock lock(_mutex);
-    array_type content = _array;
+    array_type content;
+    for (size_type i = 0; i < word_count; i++) {
+      append_word(content, i, _words[i].exchange(0, std::memory_order_acq_rel));
+    }
 
-    // Can't call clear() here to prevent dead lock.
-    _is_in_array.fill(false);
-    _array.clear();
     return content;
   }
 
   inline array_type get_content() const noexcept {
-    scoped_spin_lock lock(_mutex);
-    return _array;
+    array_type content;
+    for (size_type i = 0; i < word_count; i++) {
+      append_word(content, i, _words[i].load(std::memory_order_acquire));
+    }
+
+    return content;
   }
 
   inline size_type size() const noexcept {
-    scoped_spin_lock lock(_mutex);
-    return _array.size();
+    size_type count = 0;
+    for (const std::atomic<word_type>& w : _words) {
+      count += (size_type)std::popcount(w.load(std::memory_order_relaxed));
+    }
+
+    return count;
   }
 
   inline bool empty() const noexcept {
-    scoped_spin_lock lock(_mutex);
-    return _array.empty();
+    for (const std::atomic<word_type>& w : _words) {
+      if (w.load(std::memory_order_relaxed)) {
+        return false;
+      }
+    }
+
+    return true;
   }
 
 private:
-  array_type _array;
-  std::array<bool, maximum_size> _is_in_array;
-  mutable spin_lock_mutex _mutex;
+  using word_type = std::uint64_t;
+  static constexpr size_type word_bits = 64;
+  static constexpr size_type word_count = (maximum_size + word_bits - 1) / word_bits;
+
+  std::array<std::atomic<word_type>, word_count> _words = {};
+
+  static inline size_type word_index(value_type value) noexcept { return (size_type)value / word_bits; }
+  static inline word_type word_mask(value_type value) noexcept {
+    return word_type(1) << ((size_type)value % word_bits);
+  }
+
+  static inline void append_word(array_type& content, size_type index, word_type w) noexcept {
+    while (w) {
+      content.push_back((value_type)(index * word_bits + (size_type)std::countr_zero(w)));
+      w &= w - 1;
+    }
+  }
 };
 } // namespace fst.
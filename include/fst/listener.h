@@ -32,126 +32,519 @@
 ///
 
 #pragma once
+#include <fst/assert>
+#include <fst/config>
 #include <fst/pointer>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace fst {
-template <typename _Listener, template <class...> class _VectorType = std::vector>
+/// listener_manager
+///
+/// Listener registry with O(1) add() and remove().
+///
+/// Listeners are kept in a dense array for iteration and indexed by a hash map for membership.
+/// By default remove() moves the last listener into the freed slot. With _StableOrder, listeners
+/// stay in registration order: remove() leaves a hole that is compacted once holes make up half
+/// the array.
+///
+/// Adding or removing from notify() or for_each() is safe. A listener added during an iteration
+/// is only visited by the next one, a removed one isn't visited anymore. Holes left during
+/// the iteration are compacted when the outermost one ends. Iterating with begin() and end()
+/// doesn't defer anything, it skips the holes.
+template <typename _Listener, template <class...> class _VectorType = std::vector, bool _StableOrder = false>
 class listener_manager {
 public:
   using listener = _Listener;
   using vector_type = _VectorType<listener*>;
-  using iterator = typename vector_type::iterator;
-  using const_iterator = typename vector_type::const_iterator;
   using size_type = typename vector_type::size_type;
+  static constexpr bool stable_order = _StableOrder;
 
-  inline void add(fst::not_null<listener*> new_listener) {
-    for (listener* l : _listeners) {
-      if (l == new_listener) {
-        return;
+  /// Iterates the listeners, skipping holes.
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = listener*;
+    using difference_type = std::ptrdiff_t;
+    using pointer = listener* const*;
+    using reference = listener* const&;
+
+    const_iterator() noexcept = default;
+
+    inline reference operator*() const noexcept { return *_it; }
+    inline pointer operator->() const noexcept { return _it; }
+
+    inline const_iterator& operator++() noexcept {
+      ++_it;
+      skip_holes();
+      return *this;
+    }
+
+    inline const_iterator operator++(int) noexcept {
+      const_iterator it = *this;
+      ++(*this);
+      return it;
+    }
+
+    inline bool operator==(const const_iterator& it) const noexcept { return _it == it._it; }
+    inline bool operator!=(const const_iterator& it) const noexcept { return _it != it._it; }
+
+  private:
+    friend class listener_manager;
+
+    inline const_iterator(pointer it, pointer end) noexcept
+        : _it(it)
+        , _end(end) {
+      skip_holes();
+    }
+
+    inline void skip_holes() noexcept {
+      while (_it != _end && *_it == nullptr) {
+        ++_it;
       }
     }
 
+    pointer _it = nullptr;
+    pointer _end = nullptr;
+  };
+
+  using iterator = const_iterator;
+
+  /// Returns false if the listener was already registered.
+  inline bool add(fst::not_null<listener*> new_listener) {
+    if (!_indices.try_emplace(new_listener, _listeners.size()).second) {
+      return false;
+    }
+
     _listeners.push_back(new_listener);
+    return true;
   }
 
-  inline void remove(fst::not_null<listener*> old_listener) {
-    for (auto it = _listeners.begin(); it != _listeners.end(); ++it) {
-      if ((*it) == old_listener) {
-        _listeners.erase(it);
-        return;
+  /// Returns false if the listener wasn't registered.
+  inline bool remove(fst::not_null<listener*> old_listener) {
+    auto it = _indices.find(old_listener);
+    if (it == _indices.end()) {
+      return false;
+    }
+
+    const size_type index = it->second;
+    _indices.erase(it);
+
+    if (_iteration_depth || stable_order) {
+      _listeners[index] = nullptr;
+      _hole_count++;
+
+      if (!_iteration_depth && _hole_count * 2 > _listeners.size()) {
+        compact();
       }
+
+      return true;
     }
+
+    if (index != _listeners.size() - 1) {
+      listener* last = _listeners.back();
+      _listeners[index] = last;
+      _indices[last] = index;
+    }
+
+    _listeners.pop_back();
+    return true;
   }
 
-  inline vector_type& get() { return _listeners; }
-  inline const vector_type& get() const { return _listeners; }
+  inline bool contains(listener* l) const noexcept { return _indices.find(l) != _indices.end(); }
 
-  inline size_type size() const noexcept { return _listeners.size(); }
-  inline bool empty() const noexcept { return _listeners.empty(); }
+  inline void clear() {
+    fst_assert(!_iteration_depth, "listener_manager::clear can't be called while iterating");
+    _listeners.clear();
+    _indices.clear();
+    _hole_count = 0;
+  }
 
-  inline iterator begin() { return _listeners.begin(); }
-  inline const_iterator begin() const { return _listeners.begin(); }
-  inline iterator end() { return _listeners.end(); }
-  inline const_iterator end() const { return _listeners.end(); }
+  inline void reserve(size_type count) {
+    _listeners.reserve(count);
+    _indices.reserve(count);
+  }
+
+  /// Calls fct(listener*) on every listener, add() and remove() are deferred meanwhile.
+  template <class _Fct>
+  inline void for_each(_Fct&& fct) {
+    _iteration_depth++;
+
+    // Listeners added during the iteration are past count.
+    const size_type count = _listeners.size();
+    for (size_type i = 0; i < count; i++) {
+      if (listener* l = _listeners[i]) {
+        fct(l);
+      }
+    }
+
+    if (--_iteration_depth == 0 && _hole_count && (!stable_order || _hole_count * 2 > _listeners.size())) {
+      compact();
+    }
+  }
+
+  template <auto Fct, typename... Args>
+  inline void notify(Args&&... args) {
+    for_each([&](listener* l) { (l->*Fct)(args...); });
+  }
+
+  /// The dense array, can contain nullptr holes in stable order mode.
+  inline const vector_type& get() const noexcept { return _listeners; }
+
+  inline size_type size() const noexcept { return _listeners.size() - _hole_count; }
+  inline bool empty() const noexcept { return size() == 0; }
+
+  inline const_iterator begin() const noexcept {
+    return const_iterator(_listeners.data(), _listeners.data() + _listeners.size());
+  }
+
+  inline const_iterator end() const noexcept {
+    return const_iterator(_listeners.data() + _listeners.size(), _listeners.data() + _listeners.size());
+  }
 
 private:
   vector_type _listeners;
+  std::unordered_map<listener*, size_type> _indices;
+  size_type _hole_count = 0;
+  size_type _iteration_depth = 0;
+
+  /// Removes the holes, keeping the order.
+  inline void compact() {
+    size_type index = 0;
+    for (listener* l : _listeners) {
+      if (l) {
+        _indices[l] = index;
+        _listeners[index++] = l;
+      }
+    }
+
+    _listeners.resize(index);
+    _hole_count = 0;
+  }
 };
 
 namespace mt {
-  template <typename _Listener, typename _Mutex = std::recursive_mutex,
-      template <class...> class _VectorType = std::vector>
+  namespace detail {
+    /// Managers the calling thread is currently reading (notify() or a live snapshot).
+    /// remove() doesn't wait for readers when called from one of them.
+    struct listener_reader_stack {
+      static constexpr std::size_t maximum_depth = 32;
+
+      // Reads nested past maximum_depth are only counted. While there are some, contains()
+      // can't tell which managers they belong to and returns true.
+      inline void push(const void* manager) noexcept {
+        if (size == maximum_depth) {
+          overflow_count++;
+          return;
+        }
+
+        managers[size++] = manager;
+      }
+
+      inline void pop(const void* manager) noexcept {
+        if (overflow_count) {
+          overflow_count--;
+          return;
+        }
+
+        for (std::size_t i = size; i > 0; i--) {
+          if (managers[i - 1] == manager) {
+            for (std::size_t k = i; k < size; k++) {
+              managers[k - 1] = managers[k];
+            }
+            size--;
+            return;
+          }
+        }
+      }
+
+      inline bool contains(const void* manager) const noexcept {
+        if (overflow_count) {
+          return true;
+        }
+
+        for (std::size_t i = 0; i < size; i++) {
+          if (managers[i] == manager) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      const void* managers[maximum_depth];
+      std::size_t size = 0;
+      std::size_t overflow_count = 0;
+    };
+
+    inline thread_local listener_reader_stack listener_readers;
+  } // namespace detail.
+
+  /// listener_manager
+  ///
+  /// Thread safe listener list with copy-on-write snapshots.
+  ///
+  /// notify() never locks: it pins the current immutable snapshot with a reference count and
+  /// iterates it. add() and remove() copy the list under a writers' mutex and publish the new
+  /// snapshot atomically, so listeners can add or remove listeners (themselves included) from
+  /// a notification.
+  ///
+  /// A notification that started before a remove() can still reach the removed listener.
+  /// When called from outside a notification, remove() waits for those to finish, after it
+  /// returns the listener can be destroyed. When called from a notification of this manager,
+  /// it returns right away.
+  ///
+  /// Old snapshots are only deleted by writers, never on the notifying threads.
+  template <typename _Listener, typename _Mutex = std::mutex, template <class...> class _VectorType = std::vector>
   class listener_manager {
   public:
     using listener = _Listener;
     using vector_type = _VectorType<listener*>;
-    using iterator = typename vector_type::iterator;
     using const_iterator = typename vector_type::const_iterator;
     using size_type = typename vector_type::size_type;
     using mutex_type = _Mutex;
     using lock_guard_type = std::lock_guard<mutex_type>;
 
-    inline void add(fst::not_null<listener*> nl) {
-      lock_guard_type lk(_mutex);
+  private:
+    struct snapshot_data {
+      vector_type listeners;
+      std::atomic<std::uint32_t> refs = 0;
+    };
 
-      for (listener* l : _listeners) {
-        if (l == nl) {
-          return;
+  public:
+    /// Pinned, immutable view of the listeners.
+    class snapshot {
+    public:
+      inline ~snapshot() {
+        if (_data) {
+          _data->refs.fetch_sub(1, std::memory_order_release);
         }
+
+        detail::listener_readers.pop(_manager);
       }
 
-      _listeners.push_back(nl);
+      snapshot(const snapshot&) = delete;
+      snapshot(snapshot&&) = delete;
+
+      snapshot& operator=(const snapshot&) = delete;
+      snapshot& operator=(snapshot&&) = delete;
+
+      inline const vector_type& operator*() const noexcept { return _data ? _data->listeners : empty_vector(); }
+      inline const vector_type* operator->() const noexcept { return &**this; }
+
+      inline size_type size() const noexcept { return (**this).size(); }
+      inline bool empty() const noexcept { return (**this).empty(); }
+
+      inline const_iterator begin() const { return (**this).begin(); }
+      inline const_iterator end() const { return (**this).end(); }
+
+    private:
+      friend class listener_manager;
+
+      inline snapshot(const listener_manager* manager) noexcept
+          : _manager(manager)
+          , _data(manager->acquire()) {
+        detail::listener_readers.push(_manager);
+      }
+
+      static inline const vector_type& empty_vector() noexcept {
+        static const vector_type empty;
+        return empty;
+      }
+
+      const listener_manager* _manager;
+      snapshot_data* _data;
+    };
+
+    listener_manager() noexcept = default;
+
+    inline ~listener_manager() {
+      delete _current.load(std::memory_order_relaxed);
+
+      for (snapshot_data* data : _retired) {
+        delete data;
+      }
     }
 
-    inline void remove(fst::not_null<listener*> ol) {
-      lock_guard_type lk(_mutex);
+    listener_manager(const listener_manager&) = delete;
+    listener_manager(listener_manager&&) = delete;
 
-      for (auto it = _listeners.begin(); it != _listeners.end(); ++it) {
-        if ((*it) == ol) {
-          _listeners.erase(it);
-          return;
+    listener_manager& operator=(const listener_manager&) = delete;
+    listener_manager& operator=(listener_manager&&) = delete;
+
+    inline void add(fst::not_null<listener*> nl) {
+      update([nl](vector_type& listeners) {
+        for (listener* l : listeners) {
+          if (l == nl) {
+            return false;
+          }
+        }
+
+        listeners.push_back(nl);
+        return true;
+      });
+    }
+
+    inline void remove(fst::not_null<listener*> ol) {
+      const bool removed = update([ol](vector_type& listeners) {
+        for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+          if ((*it) == ol) {
+            listeners.erase(it);
+            return true;
+          }
         }
+
+        return false;
+      });
+
+      if (removed) {
+        wait_for_readers();
       }
     }
 
-    inline vector_type& get() { return _listeners; }
-    inline const vector_type& get() const { return _listeners; }
+    inline snapshot get() const noexcept { return snapshot(this); }
 
-    inline size_type size() const noexcept { return _listeners.size(); }
-    inline bool empty() const noexcept { return _listeners.empty(); }
-    inline void lock() { _mutex.lock(); }
-    inline void unlock() { _mutex.unlock(); }
+    inline size_type size() const noexcept { return get().size(); }
+    inline bool empty() const noexcept { return _current.load(std::memory_order_acquire) == nullptr; }
 
     template <auto Fct, typename... Args>
     inline void notify(Args&&... args) {
-      if (_listeners.empty()) {
+      if (empty()) {
         return;
       }
 
-      lock();
-      for (auto& l : _listeners) {
-        (l->*Fct)(std::forward<Args>(args)...);
+      const snapshot s = get();
+      for (listener* l : s) {
+        (l->*Fct)(args...);
       }
-      unlock();
     }
 
     inline void clear() {
-      lock();
-      _listeners.clear();
-      unlock();
-    }
+      const bool removed = update([](vector_type& listeners) {
+        if (listeners.empty()) {
+          return false;
+        }
 
-    inline void reset() {
-      lock();
-      vector_type().swap(_listeners);
-      unlock();
+        vector_type().swap(listeners);
+        return true;
+      });
+
+      if (removed) {
+        wait_for_readers();
+      }
     }
 
+    inline void reset() { clear(); }
+
   private:
-    vector_type _listeners;
+    // An empty list is published as nullptr.
+    std::atomic<snapshot_data*> _current = nullptr;
+
+    // Readers between loading _current and pinning it. Writers flip _epoch and wait for the
+    // previous side to drain, after that an unpinned old snapshot can't be pinned anymore.
+    mutable std::atomic<std::uint32_t> _pending[2] = {};
+    std::atomic<std::uint32_t> _epoch = 0;
+
+    // Old snapshots still pinned by a reader, guarded by _mutex.
+    std::vector<snapshot_data*> _retired;
     mutex_type _mutex;
+
+    inline snapshot_data* acquire() const noexcept {
+      // The epoch is read again once registered: a writer may have flipped it in between and
+      // already be done waiting on that side, a later writer would then not wait for this reader.
+      std::uint32_t epoch = _epoch.load(std::memory_order_seq_cst);
+      for (;;) {
+        _pending[epoch & 1].fetch_add(1, std::memory_order_seq_cst);
+
+        const std::uint32_t current_epoch = _epoch.load(std::memory_order_seq_cst);
+        if (FST_LIKELY(current_epoch == epoch)) {
+          break;
+        }
+
+        _pending[epoch & 1].fetch_sub(1, std::memory_order_release);
+        epoch = current_epoch;
+      }
+
+      std::atomic<std::uint32_t>& pending = _pending[epoch & 1];
+      snapshot_data* data = _current.load(std::memory_order_seq_cst);
+      if (data) {
+        data->refs.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      pending.fetch_sub(1, std::memory_order_release);
+      return data;
+    }
+
+    /// Copies the current list, applies fct and publishes the result if fct returned true.
+    template <class _Fct>
+    inline bool update(_Fct&& fct) {
+      lock_guard_type lk(_mutex);
+
+      snapshot_data* current = _current.load(std::memory_order_relaxed);
+      std::unique_ptr<snapshot_data> data = std::make_unique<snapshot_data>();
+      if (current) {
+        data->listeners = current->listeners;
+      }
+
+      if (!fct(data->listeners)) {
+        return false;
+      }
+
+      snapshot_data* old = _current.exchange(data->listeners.empty() ? nullptr : data.release(), std::memory_order_seq_cst);
+
+      // The pinning window doesn't run any user code, this is a short wait.
+      const std::uint32_t parity = _epoch.fetch_add(1, std::memory_order_seq_cst) & 1;
+      while (_pending[parity].load(std::memory_order_seq_cst) != 0) {
+        FST_NOP();
+      }
+
+      if (old) {
+        _retired.push_back(old);
+      }
+
+      collect();
+      return true;
+    }
+
+    /// Deletes the retired snapshots that aren't pinned anymore, _mutex must be held.
+    inline void collect() noexcept {
+      for (std::size_t i = 0; i < _retired.size();) {
+        if (_retired[i]->refs.load(std::memory_order_acquire) == 0) {
+          delete _retired[i];
+          _retired[i] = _retired.back();
+          _retired.pop_back();
+        }
+        else {
+          i++;
+        }
+      }
+    }
+
+    /// Waits until no reader holds an old snapshot, unless the calling thread is one of them.
+    inline void wait_for_readers() {
+      if (detail::listener_readers.contains(this)) {
+        return;
+      }
+
+      for (;;) {
+        {
+          lock_guard_type lk(_mutex);
+          collect();
+
+          if (_retired.empty()) {
+            return;
+          }
+        }
+
+        std::this_thread::yield();
+      }
+    }
   };
 } // namespace mt.
 } // namespace fst.
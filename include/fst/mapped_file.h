@@ -32,13 +32,20 @@
 ///
 
 #pragma once
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <string_view>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
 
 #include <fst/assert>
+#include <fst/byte_view>
+#include <fst/config>
 #include <fst/print>
 #include <fst/span>
 
@@ -64,6 +71,7 @@
     #include <fcntl.h>
     #include <sys/types.h>
     #include <sys/mman.h>
+    #include <sys/stat.h>
     namespace fst::config { inline constexpr bool has_memory_map = true; }
   #else
     namespace fst::config { inline constexpr bool has_memory_map = false; }
@@ -74,6 +82,28 @@
 // clang-format on
 
 namespace fst {
+/// Hints given to the system when a file is mapped, they never change the content.
+struct mapped_file_options {
+  enum class access_pattern {
+    normal,
+    /// Read once from start to end, readahead is more aggressive and pages are dropped sooner.
+    sequential,
+    /// No locality, readahead is disabled.
+    random
+  };
+
+  access_pattern access = access_pattern::normal;
+
+  /// Starts reading the whole file in the background.
+  bool will_need = false;
+
+  /// Faults all the pages in before open() returns (MAP_POPULATE, Linux only).
+  bool populate = false;
+
+  /// Asks for transparent huge pages where the file system supports them (Linux only).
+  bool huge_pages = false;
+};
+
 class mapped_file {
 public:
   using value_type = std::uint8_t;
@@ -138,7 +168,7 @@ public:
     return *(_data + _size - 1);
   }
 
-  bool open(const std::filesystem::path& file_path) {
+  bool open(const std::filesystem::path& file_path, const mapped_file_options& options = {}) {
     if (_data) {
       close();
     }
@@ -147,22 +177,39 @@ public:
     std::filesystem::path w_path = file_path;
     w_path.make_preferred();
 
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (options.access == mapped_file_options::access_pattern::sequential) {
+      flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+    else if (options.access == mapped_file_options::access_pattern::random) {
+      flags |= FILE_FLAG_RANDOM_ACCESS;
+    }
+
     HANDLE hFile = CreateFileW(
-        (LPCWSTR)w_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL, nullptr);
+        (LPCWSTR)w_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
     if (hFile == INVALID_HANDLE_VALUE) {
       fst::errprint("mapped_file : CreateFileA -> INVALID_HANDLE_VALUE");
       return false;
     }
 
-    DWORD size = GetFileSize(hFile, nullptr);
-    if (size == INVALID_FILE_SIZE || size == 0) {
-      fst::errprint("mapped_file : CreateFileA -> INVALID_FILE_SIZE");
+    // GetFileSize only returns the low 32 bits.
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(hFile, &file_size) || file_size.QuadPart <= 0) {
+      fst::errprint("mapped_file : GetFileSizeEx -> invalid file size");
       CloseHandle(hFile);
       return false;
     }
 
-    HANDLE hMap = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, size, nullptr);
+    // Doesn't fit in the address space, see windowed_mapped_file.
+    if ((std::uint64_t)file_size.QuadPart > (std::uint64_t)SIZE_MAX) {
+      fst::errprint("mapped_file : file too large to be mapped whole");
+      CloseHandle(hFile);
+      return false;
+    }
+
+    const size_type size = (size_type)file_size.QuadPart;
+    HANDLE hMap = CreateFileMappingA(
+        hFile, nullptr, PAGE_READONLY, (DWORD)file_size.HighPart, file_size.LowPart, nullptr);
     if (!hMap) {
       fst::errprint("mapped_file : CreateFileMappingA -> nulll");
       CloseHandle(hFile);
@@ -173,8 +220,18 @@ public:
 
     // We can call CloseHandle here, but it will not be closed until we unmap the view.
     CloseHandle(hMap);
+    CloseHandle(hFile);
+    if (!data) {
+      return false;
+    }
+
     _data = data;
-    _size = (size_type)size;
+    _size = size;
+
+    if (options.will_need || options.populate) {
+      prefetch(0, _size);
+    }
+
     return true;
 
 #elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
@@ -190,12 +247,33 @@ public:
       return false;
     }
 
+  #if __FST_LINUX__
+    // Page cache readahead for the file, madvise below only covers the mapping.
+    if (options.access == mapped_file_options::access_pattern::sequential) {
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    else if (options.access == mapped_file_options::access_pattern::random) {
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    }
+
+    if (options.will_need) {
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+  #endif
+
+    int map_flags = MAP_PRIVATE;
+  #ifdef MAP_POPULATE
+    if (options.populate) {
+      map_flags |= MAP_POPULATE;
+    }
+  #endif
+
     // MAP_PRIVATE
     // Create a private copy-on-write mapping. Updates to the mapping are not visible to other
     // processes mapping the same file, and are not carried through to the underlying file.
     // It is unspecified whether changes made to the file after the mmap() call are visible
     // in the mapped region.
-    pointer data = (pointer)mmap(nullptr, (size_type)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    pointer data = (pointer)mmap(nullptr, (size_type)size, PROT_READ, map_flags, fd, 0);
     // pointer data = (pointer)mmap(nullptr, (size_type)size, PROT_READ, MAP_SHARED, fd, 0);
 
     if (data == MAP_FAILED) {
@@ -206,9 +284,28 @@ public:
     ::close(fd);
     _data = data;
     _size = (size_type)size;
+
+    if (options.access == mapped_file_options::access_pattern::sequential) {
+      ::madvise(_data, _size, MADV_SEQUENTIAL);
+    }
+    else if (options.access == mapped_file_options::access_pattern::random) {
+      ::madvise(_data, _size, MADV_RANDOM);
+    }
+
+  #ifdef MADV_HUGEPAGE
+    if (options.huge_pages) {
+      ::madvise(_data, _size, MADV_HUGEPAGE);
+    }
+  #endif
+
+    if (options.will_need) {
+      prefetch(0, _size);
+    }
+
     return true;
 
 #else
+    (void)options;
     std::FILE* fd = std::fopen(file_path.c_str(), "rb");
     if (!fd) {
       return false;
@@ -243,6 +340,61 @@ public:
 #endif
   }
 
+  /// Starts reading [offset, offset + length) in the background, doesn't wait for it.
+  bool prefetch(size_type offset, size_type length) noexcept {
+    if (!clamp_range(offset, length)) {
+      return false;
+    }
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP && defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = _data + offset;
+    range.NumberOfBytes = length;
+    return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    const size_type aligned_offset = page_aligned(offset);
+    return ::madvise(_data + aligned_offset, length + (offset - aligned_offset), MADV_WILLNEED) == 0;
+#else
+    // Already in memory.
+    return true;
+#endif
+  }
+
+  /// Keeps [offset, offset + length) resident in memory until unlock() or close().
+  bool lock(size_type offset, size_type length) noexcept {
+    if (!clamp_range(offset, length)) {
+      return false;
+    }
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    return VirtualLock(_data + offset, length);
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    const size_type aligned_offset = page_aligned(offset);
+    return ::mlock(_data + aligned_offset, length + (offset - aligned_offset)) == 0;
+#else
+    return false;
+#endif
+  }
+
+  inline bool lock() noexcept { return lock(0, _size); }
+
+  bool unlock(size_type offset, size_type length) noexcept {
+    if (!clamp_range(offset, length)) {
+      return false;
+    }
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    return VirtualUnlock(_data + offset, length);
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    const size_type aligned_offset = page_aligned(offset);
+    return ::munlock(_data + aligned_offset, length + (offset - aligned_offset)) == 0;
+#else
+    return false;
+#endif
+  }
+
+  inline bool unlock() noexcept { return unlock(0, _size); }
+
   void close() {
     if (_data == nullptr) {
       return;
@@ -263,5 +415,674 @@ public:
 private:
   pointer _data = nullptr;
   size_type _size = 0;
+
+  /// Clips length to the end of the file, returns false if there is nothing left.
+  inline bool clamp_range(size_type offset, size_type& length) const noexcept {
+    if (!_data || offset >= _size || length == 0) {
+      return false;
+    }
+
+    length = std::min(length, _size - offset);
+    return true;
+  }
+
+#if __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+  static inline size_type page_aligned(size_type offset) noexcept {
+    const size_type page_size = (size_type)::sysconf(_SC_PAGESIZE);
+    return offset - offset % page_size;
+  }
+#endif
 };
+
+/// writable_mapped_file
+///
+/// Read/write shared mapping of a file, writes go straight to the file through the page cache.
+///
+/// The file can be created with a given size and resized while mapped, on Linux the mapping
+/// is grown with mremap, which avoids copying and may keep the same address. Any resize can
+/// move the mapping, pointers into data() are invalidated.
+///
+/// An empty file is a valid open file with a null data().
+class writable_mapped_file {
+public:
+  using value_type = std::uint8_t;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+  using iterator = pointer;
+  using const_iterator = const_pointer;
+  using size_type = std::size_t;
+
+  writable_mapped_file() noexcept = default;
+  writable_mapped_file(const writable_mapped_file&) = delete;
+  inline writable_mapped_file(writable_mapped_file&& f) noexcept
+      : _data(f._data)
+      , _size(f._size)
+      , _file(f._file) {
+    f._data = nullptr;
+    f._size = 0;
+    f._file = invalid_file;
+  }
+
+  inline ~writable_mapped_file() { close(); }
+
+  writable_mapped_file& operator=(const writable_mapped_file&) = delete;
+  inline writable_mapped_file& operator=(writable_mapped_file&& f) noexcept {
+    if (this != &f) {
+      close();
+      _data = f._data;
+      _size = f._size;
+      _file = f._file;
+      f._data = nullptr;
+      f._size = 0;
+      f._file = invalid_file;
+    }
+    return *this;
+  }
+
+  inline bool is_open() const noexcept { return _file != invalid_file; }
+  inline size_type size() const noexcept { return _size; }
+  inline bool empty() const noexcept { return _size == 0; }
+
+  inline pointer data() noexcept { return _data; }
+  inline const_pointer data() const noexcept { return _data; }
+
+  inline fst::span<value_type> content() noexcept { return fst::span<value_type>(_data, _size); }
+  inline fst::span<const value_type> content() const noexcept {
+    return fst::span<const value_type>(_data, _size);
+  }
+
+  inline iterator begin() noexcept { return _data; }
+  inline iterator end() noexcept { return _data + _size; }
+  inline const_iterator begin() const noexcept { return _data; }
+  inline const_iterator end() const noexcept { return _data + _size; }
+
+  inline value_type& operator[](size_type __n) noexcept {
+    fst_assert(__n < size(), "index out of bounds");
+    return _data[__n];
+  }
+
+  inline value_type operator[](size_type __n) const noexcept {
+    fst_assert(__n < size(), "index out of bounds");
+    return _data[__n];
+  }
+
+  /// Opens an existing file for reading and writing.
+  inline bool open(const std::filesystem::path& file_path) { return open_file(file_path, false, 0); }
+
+  /// Creates the file, or truncates it if it exists, filled with file_size zero bytes.
+  inline bool create(const std::filesystem::path& file_path, size_type file_size) {
+    return open_file(file_path, true, file_size);
+  }
+
+  /// Grows or shrinks the file and its mapping, new bytes are zeros.
+  bool resize(size_type new_size) {
+    if (!is_open()) {
+      return false;
+    }
+
+    if (new_size == _size) {
+      return true;
+    }
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    unmap();
+
+    LARGE_INTEGER li;
+    li.QuadPart = (LONGLONG)new_size;
+    if (!SetFilePointerEx(_file, li, nullptr, FILE_BEGIN) || !SetEndOfFile(_file)) {
+      fst::errprint("writable_mapped_file : SetEndOfFile failed");
+      return map(file_size());
+    }
+
+    return map(new_size);
+
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    if (::ftruncate(_file, (off_t)new_size) != 0) {
+      return false;
+    }
+
+    if (new_size == 0) {
+      unmap();
+      return true;
+    }
+
+    if (!_data) {
+      return map(new_size);
+    }
+
+  #if __FST_LINUX__
+    void* data = ::mremap(_data, _size, new_size, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+      unmap();
+      return map(new_size);
+    }
+
+    _data = (pointer)data;
+    _size = new_size;
+    return true;
+  #else
+    unmap();
+    return map(new_size);
+  #endif
+
+#else
+    return false;
+#endif
+  }
+
+  /// Writes the modified pages of the whole mapping to the file and waits for completion.
+  inline bool flush() { return flush(0, _size); }
+
+  /// Writes the modified pages in [offset, offset + count) to the file and waits for completion.
+  bool flush(size_type offset, size_type count) {
+    if (!_data || offset >= _size) {
+      return is_open();
+    }
+
+    count = std::min(count, _size - offset);
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    return FlushViewOfFile(_data + offset, count) && FlushFileBuffers(_file);
+
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    // msync needs a page aligned address.
+    const size_type page_size = (size_type)::sysconf(_SC_PAGESIZE);
+    const size_type aligned_offset = offset - offset % page_size;
+    return ::msync(_data + aligned_offset, count + (offset - aligned_offset), MS_SYNC) == 0;
+
+#else
+    return false;
+#endif
+  }
+
+  void close() {
+    if (!is_open()) {
+      return;
+    }
+
+    unmap();
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    CloseHandle(_file);
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    ::close(_file);
+#endif
+
+    _file = invalid_file;
+  }
+
+private:
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+  using file_type = HANDLE;
+  static inline const file_type invalid_file = INVALID_HANDLE_VALUE;
+#else
+  using file_type = int;
+  static constexpr file_type invalid_file = -1;
+#endif
+
+  pointer _data = nullptr;
+  size_type _size = 0;
+  file_type _file = invalid_file;
+
+  bool open_file(const std::filesystem::path& file_path, bool truncate, size_type file_size) {
+    close();
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    std::filesystem::path w_path = file_path;
+    w_path.make_preferred();
+
+    _file = CreateFileW((LPCWSTR)w_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        truncate ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+      fst::errprint("writable_mapped_file : CreateFileW -> INVALID_HANDLE_VALUE");
+      return false;
+    }
+
+    if (truncate) {
+      LARGE_INTEGER li;
+      li.QuadPart = (LONGLONG)file_size;
+      if (!SetFilePointerEx(_file, li, nullptr, FILE_BEGIN) || !SetEndOfFile(_file)) {
+        close();
+        return false;
+      }
+    }
+    else {
+      file_size = this->file_size();
+    }
+
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    _file = ::open(file_path.c_str(), truncate ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+    if (_file < 0) {
+      _file = invalid_file;
+      return false;
+    }
+
+    if (truncate) {
+      if (::ftruncate(_file, (off_t)file_size) != 0) {
+        close();
+        return false;
+      }
+    }
+    else {
+      file_size = this->file_size();
+    }
+
+#else
+    (void)file_path;
+    (void)truncate;
+    (void)file_size;
+    return false;
+#endif
+
+    if (!map(file_size)) {
+      close();
+      return false;
+    }
+
+    return true;
+  }
+
+  inline size_type file_size() const noexcept {
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    LARGE_INTEGER li;
+    return GetFileSizeEx(_file, &li) ? (size_type)li.QuadPart : 0;
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    struct stat st;
+    return ::fstat(_file, &st) == 0 ? (size_type)st.st_size : 0;
+#else
+    return 0;
+#endif
+  }
+
+  bool map(size_type map_size) {
+    if (map_size == 0) {
+      return true;
+    }
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    const std::uint64_t size64 = (std::uint64_t)map_size;
+    HANDLE hMap = CreateFileMappingW(
+        _file, nullptr, PAGE_READWRITE, (DWORD)(size64 >> 32), (DWORD)(size64 & 0xFFFFFFFF), nullptr);
+    if (!hMap) {
+      fst::errprint("writable_mapped_file : CreateFileMappingW -> null");
+      return false;
+    }
+
+    pointer data = (pointer)MapViewOfFile(hMap, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, map_size);
+
+    // The mapping stays alive until the view is unmapped.
+    CloseHandle(hMap);
+    if (!data) {
+      return false;
+    }
+
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    // MAP_SHARED
+    // Updates to the mapping are visible to other processes mapping the same region,
+    // and are carried through to the underlying file.
+    void* mapped = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+    if (mapped == MAP_FAILED) {
+      return false;
+    }
+
+    pointer data = (pointer)mapped;
+#else
+    return false;
+#endif
+
+    _data = data;
+    _size = map_size;
+    return true;
+  }
+
+  inline void unmap() noexcept {
+    if (_data) {
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+      UnmapViewOfFile(_data);
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+      ::munmap(_data, _size);
+#endif
+    }
+
+    _data = nullptr;
+    _size = 0;
+  }
+};
+
+/// windowed_mapped_file
+///
+/// Read-only access to files too large to be mapped whole.
+///
+/// The file is mapped on demand in fixed-size windows aligned to the allocation granularity
+/// (the page size on POSIX, 64 KiB on Windows). At most view_count windows are mapped at once,
+/// the least recently used one is unmapped to make room for a new one.
+///
+/// A byte_view returned by window() stays valid until its window is evicted, that is after
+/// view_count other windows were used. A cursor doesn't hold views, it reads across window
+/// boundaries and maps windows as it goes.
+class windowed_mapped_file {
+public:
+  using value_type = std::uint8_t;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+  using size_type = std::size_t;
+  using offset_type = std::uint64_t;
+
+  static constexpr size_type default_window_size = 64 * 1024 * 1024;
+  static constexpr size_type default_view_count = 4;
+
+  class cursor;
+
+  windowed_mapped_file() noexcept = default;
+  windowed_mapped_file(const windowed_mapped_file&) = delete;
+  windowed_mapped_file(windowed_mapped_file&&) = delete;
+
+  inline ~windowed_mapped_file() { close(); }
+
+  windowed_mapped_file& operator=(const windowed_mapped_file&) = delete;
+  windowed_mapped_file& operator=(windowed_mapped_file&&) = delete;
+
+  bool open(const std::filesystem::path& file_path, size_type window_size = default_window_size,
+      size_type view_count = default_view_count) {
+    close();
+
+    if (window_size == 0 || view_count == 0) {
+      return false;
+    }
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    std::filesystem::path w_path = file_path;
+    w_path.make_preferred();
+
+    _file = CreateFileW((LPCWSTR)w_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+      fst::errprint("windowed_mapped_file : CreateFileW -> INVALID_HANDLE_VALUE");
+      return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(_file, &file_size) || file_size.QuadPart <= 0) {
+      close();
+      return false;
+    }
+
+    _size = (offset_type)file_size.QuadPart;
+    _map = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!_map) {
+      fst::errprint("windowed_mapped_file : CreateFileMappingW -> null");
+      close();
+      return false;
+    }
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const size_type granularity = (size_type)info.dwAllocationGranularity;
+
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    _file = ::open(file_path.c_str(), O_RDONLY);
+    if (_file < 0) {
+      _file = invalid_file;
+      return false;
+    }
+
+    struct stat st;
+    if (::fstat(_file, &st) != 0 || st.st_size <= 0) {
+      close();
+      return false;
+    }
+
+    _size = (offset_type)st.st_size;
+    const size_type granularity = (size_type)::sysconf(_SC_PAGESIZE);
+
+#else
+    (void)file_path;
+    return false;
+#endif
+
+    _window_size = ((window_size + granularity - 1) / granularity) * granularity;
+    _views.assign(view_count, view{});
+    return true;
+  }
+
+  void close() {
+    for (view& v : _views) {
+      unmap(v);
+    }
+
+    _views.clear();
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    if (_map) {
+      CloseHandle(_map);
+      _map = nullptr;
+    }
+
+    if (_file != invalid_file) {
+      CloseHandle(_file);
+    }
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    if (_file != invalid_file) {
+      ::close(_file);
+    }
+#endif
+
+    _file = invalid_file;
+    _size = 0;
+    _window_size = 0;
+  }
+
+  inline bool is_open() const noexcept { return _file != invalid_file; }
+  inline offset_type size() const noexcept { return _size; }
+  inline size_type window_size() const noexcept { return _window_size; }
+  inline size_type view_count() const noexcept { return _views.size(); }
+
+  /// Bytes from offset to the end of its window, empty if offset is out of range or the
+  /// window can't be mapped.
+  inline fst::byte_view window(offset_type offset) {
+    if (offset >= _size) {
+      return fst::byte_view();
+    }
+
+    const view* v = acquire(offset / _window_size);
+    if (!v) {
+      return fst::byte_view();
+    }
+
+    const size_type index = (size_type)(offset - v->index * _window_size);
+    return fst::byte_view(v->data + index, v->size - index);
+  }
+
+  /// Copies up to count bytes at offset, returns the number of bytes copied.
+  inline size_type read(offset_type offset, void* buffer, size_type count) {
+    size_type copied = 0;
+    while (copied < count) {
+      fst::byte_view w = window(offset + copied);
+      if (w.empty()) {
+        break;
+      }
+
+      const size_type n = std::min(w.size(), count - copied);
+      std::memcpy((pointer)buffer + copied, w.data(), n);
+      copied += n;
+    }
+
+    return copied;
+  }
+
+  inline cursor get_cursor(offset_type offset = 0) noexcept;
+
+private:
+  struct view {
+    offset_type index = 0;
+    pointer data = nullptr;
+    size_type size = 0;
+    std::uint64_t last_use = 0;
+  };
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+  using file_type = HANDLE;
+  static inline const file_type invalid_file = INVALID_HANDLE_VALUE;
+  HANDLE _map = nullptr;
+#else
+  using file_type = int;
+  static constexpr file_type invalid_file = -1;
+#endif
+
+  file_type _file = invalid_file;
+  offset_type _size = 0;
+  size_type _window_size = 0;
+  std::vector<view> _views;
+  std::uint64_t _use_clock = 0;
+
+  // Incremented every time a window is unmapped, cursors use it to know when to look up their window again.
+  std::uint64_t _eviction_count = 0;
+
+  inline const view* acquire(offset_type index) {
+    view* lru = &_views[0];
+
+    for (view& v : _views) {
+      if (v.data && v.index == index) {
+        v.last_use = ++_use_clock;
+        return &v;
+      }
+
+      if (!v.data) {
+        lru = &v;
+      }
+      else if (lru->data && v.last_use < lru->last_use) {
+        lru = &v;
+      }
+    }
+
+    unmap(*lru);
+
+    const offset_type offset = index * _window_size;
+    const size_type size = (size_type)std::min<offset_type>(_window_size, _size - offset);
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    pointer data = (pointer)MapViewOfFile(
+        _map, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)(offset & 0xFFFFFFFF), size);
+    if (!data) {
+      return nullptr;
+    }
+
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, _file, (off_t)offset);
+    if (mapped == MAP_FAILED) {
+      return nullptr;
+    }
+
+    pointer data = (pointer)mapped;
+#else
+    pointer data = nullptr;
+    return nullptr;
+#endif
+
+    lru->index = index;
+    lru->data = data;
+    lru->size = size;
+    lru->last_use = ++_use_clock;
+    return lru;
+  }
+
+  inline void unmap(view& v) noexcept {
+    if (!v.data) {
+      return;
+    }
+
+#if __FST_MAPPED_FILE_USE_WINDOWS_MEMORY_MAP
+    UnmapViewOfFile(v.data);
+#elif __FST_MAPPED_FILE_USE_POSIX_MEMORY_MAP
+    ::munmap(v.data, v.size);
+#endif
+
+    v = view{};
+    _eviction_count++;
+  }
+};
+
+/// Sequential reader over a windowed_mapped_file.
+class windowed_mapped_file::cursor {
+public:
+  inline cursor(windowed_mapped_file& file, offset_type offset = 0) noexcept
+      : _file(&file)
+      , _offset(offset) {}
+
+  inline offset_type tell() const noexcept { return _offset; }
+  inline offset_type remaining() const noexcept { return _offset < _file->size() ? _file->size() - _offset : 0; }
+  inline bool eof() const noexcept { return _offset >= _file->size(); }
+
+  inline void seek(offset_type offset) noexcept { _offset = offset; }
+  inline void skip(offset_type count) noexcept { _offset += count; }
+
+  /// Bytes from the cursor to the end of the current window, doesn't move the cursor.
+  inline fst::byte_view contiguous() {
+    if (_window.empty() || _eviction_count != _file->_eviction_count || _offset < _window_offset
+        || _offset - _window_offset >= _window.size()) {
+      _window = _file->window(_offset);
+      _window_offset = _offset;
+      _eviction_count = _file->_eviction_count;
+    }
+
+    if (_window.empty()) {
+      return fst::byte_view();
+    }
+
+    const size_type index = (size_type)(_offset - _window_offset);
+    return fst::byte_view(_window.data() + index, _window.size() - index);
+  }
+
+  /// Copies up to count bytes and moves the cursor, returns the number of bytes copied.
+  inline size_type read(void* buffer, size_type count) {
+    size_type copied = 0;
+    while (copied < count) {
+      fst::byte_view w = contiguous();
+      if (w.empty()) {
+        break;
+      }
+
+      const size_type n = std::min(w.size(), count - copied);
+      std::memcpy((pointer)buffer + copied, w.data(), n);
+      copied += n;
+      _offset += n;
+    }
+
+    return copied;
+  }
+
+  /// Reads a T and moves the cursor, returns a value initialized T past the end of the file.
+  template <typename T, bool _IsLittleEndian = true>
+  inline T read() {
+    static_assert(std::is_trivially_copyable<T>::value, "Type cannot be serialized.");
+
+    T value{};
+    fst::byte_view w = contiguous();
+    if (FST_LIKELY(w.size() >= sizeof(T))) {
+      std::memcpy(&value, w.data(), sizeof(T));
+      _offset += sizeof(T);
+    }
+    else if (read(&value, sizeof(T)) != sizeof(T)) {
+      return T{};
+    }
+
+    if constexpr (!_IsLittleEndian) {
+      value_type* value_data = reinterpret_cast<value_type*>(&value);
+      std::reverse(value_data, value_data + sizeof(T));
+    }
+
+    return value;
+  }
+
+private:
+  windowed_mapped_file* _file;
+  offset_type _offset;
+  fst::byte_view _window;
+  offset_type _window_offset = 0;
+  std::uint64_t _eviction_count = 0;
+};
+
+inline windowed_mapped_file::cursor windowed_mapped_file::get_cursor(offset_type offset) noexcept {
+  return cursor(*this, offset);
+}
 } // namespace fst.
@@ -0,0 +1,173 @@
+///
+/// BSD 3-Clause License
+///
+/// Copyright (c) 2021, Alexandre Arsenault
+/// All rights reserved.
+///
+/// Redistribution and use in source and binary forms, with or without
+/// modification, are permitted provided that the following conditions are met:
+///
+/// * Redistributions of source code must retain the above copyright notice, this
+///   list of conditions and the following disclaimer.
+///
+/// * Redistributions in binary form must reproduce the above copyright notice,
+///   this list of conditions and the following disclaimer in the documentation
+///   and/or other materials provided with the distribution.
+///
+/// * Neither the name of the copyright holder nor the names of its
+///   contributors may be used to endorse or promote products derived from
+///   this software without specific prior written permission.
+///
+/// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+/// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+/// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+/// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+/// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+/// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+/// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+/// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+/// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+/// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+/// POSSIBILITY OF SUCH DAMAGE.
+///
+
+#pragma once
+#include <fst/allocator>
+#include <algorithm>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+
+#if __FST_HAS_EXCEPTIONS__
+#define FST_MEMORY_RESOURCE_THROW_BAD_ALLOC() throw std::bad_alloc()
+#else
+#define FST_MEMORY_RESOURCE_THROW_BAD_ALLOC() fst_error("pmr_resource : Allocation failed.")
+#endif // __FST_HAS_EXCEPTIONS__.
+
+namespace fst {
+/// pmr_resource
+///
+/// std::pmr::memory_resource backed by an fst allocator (e.g. memory_pool_allocator).
+/// Ref counted allocators are copied, so the resource shares the pool with the fst::allocator
+/// containers that use it.
+///
+/// Alignments above the default_alignment of the allocator require an allocate(size, alignment)
+/// overload. Deallocation goes through realloc(ptr, size, 0) and does nothing for allocators
+/// that are not freeable.
+/// @tparam BaseAllocator Any type implementing the Allocator concept.
+template <typename BaseAllocator>
+class pmr_resource : public std::pmr::memory_resource {
+public:
+  using base_allocator_type = BaseAllocator;
+
+  pmr_resource() = default;
+
+  explicit pmr_resource(const base_allocator_type& allocator)
+      : _allocator(allocator) {}
+
+  ~pmr_resource() override = default;
+
+  pmr_resource(const pmr_resource&) = delete;
+  pmr_resource& operator=(const pmr_resource&) = delete;
+
+  inline base_allocator_type& get_allocator() noexcept { return _allocator; }
+  inline const base_allocator_type& get_allocator() const noexcept { return _allocator; }
+
+private:
+  void* do_allocate(std::size_t size, std::size_t alignment) override {
+    // A memory_resource never returns nullptr, even for zero bytes.
+    size = std::max<std::size_t>(size, 1);
+    void* ptr = nullptr;
+
+    if (alignment <= detail::get_default_alignment<base_allocator_type>()) {
+      ptr = _allocator.allocate(size);
+    }
+    else if constexpr (detail::has_aligned_allocate<base_allocator_type>) {
+      ptr = _allocator.allocate(size, alignment);
+    }
+
+    if (!ptr) {
+      FST_MEMORY_RESOURCE_THROW_BAD_ALLOC();
+    }
+
+    return ptr;
+  }
+
+  void do_deallocate(void* ptr, std::size_t size, std::size_t) override {
+    if constexpr (base_allocator_type::is_freeable) {
+      static_cast<void>(_allocator.realloc(ptr, std::max<std::size_t>(size, 1), 0));
+    }
+    else {
+      fst::unused(ptr, size);
+    }
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    if (this == &other) {
+      return true;
+    }
+
+    const pmr_resource* rhs = dynamic_cast<const pmr_resource*>(&other);
+    return rhs && _allocator == rhs->_allocator;
+  }
+
+  base_allocator_type _allocator;
+};
+
+/// memory_resource_allocator
+///
+/// Allocator concept implementation on top of a std::pmr::memory_resource,
+/// for fst::allocator containers that need to share a resource with std::pmr containers.
+/// Memory blocks are aligned on alignof(std::max_align_t).
+/// @note implements Allocator concept, free() requires the size of the block.
+class memory_resource_allocator : public internal_allocator_base<memory_resource_allocator, true, false> {
+public:
+  static constexpr std::size_t default_alignment = alignof(std::max_align_t);
+
+  /// Uses std::pmr::get_default_resource().
+  memory_resource_allocator() noexcept
+      : _resource(std::pmr::get_default_resource()) {}
+
+  /// implicit.
+  memory_resource_allocator(std::pmr::memory_resource* resource) noexcept
+      : _resource(resource) {
+    fst_assert(_resource, "Invalid memory resource.");
+  }
+
+  inline void* allocate(std::size_t size) {
+    return size ? _resource->allocate(size, default_alignment) : nullptr;
+  }
+
+  inline void* realloc(void* original_ptr, std::size_t original_size, std::size_t new_size) {
+    if (new_size == 0) {
+      free(original_ptr, original_size);
+      return nullptr;
+    }
+
+    void* ptr = allocate(new_size);
+    if (original_ptr) {
+      std::memcpy(ptr, original_ptr, std::min(original_size, new_size));
+      free(original_ptr, original_size);
+    }
+
+    return ptr;
+  }
+
+  inline void free(void* ptr, std::size_t size) noexcept {
+    if (ptr) {
+      _resource->deallocate(ptr, size, default_alignment);
+    }
+  }
+
+  inline std::pmr::memory_resource* get_resource() const noexcept { return _resource; }
+
+  inline bool operator==(const memory_resource_allocator& rhs) const noexcept {
+    return _resource == rhs._resource || _resource->is_equal(*rhs._resource);
+  }
+
+  inline bool operator!=(const memory_resource_allocator& rhs) const noexcept { return !operator==(rhs); }
+
+private:
+  std::pmr::memory_resource* _resource;
+};
+} // namespace fst.
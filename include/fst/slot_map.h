@@ -34,6 +34,10 @@
 ///
 #pragma once
 #include <fst/assert>
+#include <fst/span>
+#include <algorithm>
+#include <cstring>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -64,6 +68,68 @@ namespace slot_map_detail {
   inline void reserve_if_possible(Ctr& ctr, const SizeType& n) {
     slot_map_detail::reserve_if_possible(ctr, n, priority_tag<1>{});
   }
+
+  /// Free list and generations of the slots, shared by slot_map and soa_slot_map.
+  ///
+  /// Either next == last == slots.size(), or else 0 <= next < slots.size() and the "key" of that
+  /// slot entry points to the subsequent available slot, and so on, until reaching last (which
+  /// might equal next if there is only one available slot at the moment).
+  template <class Key>
+  struct slot_free_list {
+    using key_type = Key;
+    using key_index_type = typename key_type::index_type;
+    using key_generation_type = typename key_type::generation_type;
+
+    key_index_type next{};
+    key_index_type last{};
+
+    /// Takes the first available slot (or a new one) and points it to value_index.
+    /// Returns the key of that slot.
+    template <class Slots, class SizeType>
+    constexpr key_type acquire(Slots& slots, SizeType value_index) {
+      if (next == slots.size()) {
+        // Make a new slot.
+        slots.emplace_back(key_type{ static_cast<key_index_type>(next + 1), key_generation_type{} });
+        last = next + 1;
+      }
+
+      const key_index_type slot_index = next;
+      auto slot_iter = std::next(slots.begin(), slot_index);
+
+      if (next == last) {
+        next = static_cast<key_index_type>(slots.size());
+        last = next;
+      }
+      else {
+        next = slot_iter->get_index();
+      }
+
+      slot_iter->set_index(value_index);
+      key_type result = *slot_iter;
+      result.set_index(slot_index);
+      return result;
+    }
+
+    /// Pushes the slot at the end of the free list and increments its generation.
+    template <class Slots>
+    constexpr void expire(Slots& slots, key_index_type slot_index) {
+      if (next == slots.size()) {
+        next = slot_index;
+        last = slot_index;
+      }
+      else {
+        std::next(slots.begin(), last)->set_index(slot_index);
+        last = slot_index;
+      }
+
+      std::next(slots.begin(), slot_index)->increment_generation();
+    }
+
+    constexpr void clear() noexcept {
+      next = key_index_type{};
+      last = key_index_type{};
+    }
+  };
 } // namespace slot_map_detail
 
 template <typename _IndexType, typename _GenType>
@@ -236,7 +302,7 @@ public:
     key_index_type original_num_slots = static_cast<key_index_type>(slots_.size());
 
     if (original_num_slots < n) {
-      slots_.emplace_back(key_type{ next_available_slot_index_, key_generation_type{} });
+      slots_.emplace_back(key_type{ free_list_.next, key_generation_type{} });
       key_index_type last_new_slot = original_num_slots;
       --n;
 
@@ -245,7 +311,7 @@ public:
         ++last_new_slot;
       }
 
-      next_available_slot_index_ = last_new_slot;
+      free_list_.next = last_new_slot;
     }
   }
 
@@ -262,30 +328,8 @@ public:
   constexpr key_type emplace(Args&&... args) {
     auto value_pos = values_.size();
     values_.emplace_back(std::forward<Args>(args)...);
-    reverse_map_.emplace_back(next_available_slot_index_);
-
-    if (next_available_slot_index_ == slots_.size()) {
-      auto idx = next_available_slot_index_;
-      ++idx;
-
-      // Make a new slot.
-      slots_.emplace_back(key_type{ idx, key_generation_type{} });
-      last_available_slot_index_ = idx;
-    }
-
-    auto slot_iter = std::next(slots_.begin(), next_available_slot_index_);
-    if (next_available_slot_index_ == last_available_slot_index_) {
-      next_available_slot_index_ = static_cast<key_index_type>(slots_.size());
-      last_available_slot_index_ = next_available_slot_index_;
-    }
-    else {
-      next_available_slot_index_ = slot_iter->get_index();
-    }
-
-    slot_iter->set_index(value_pos);
-    key_type result = *slot_iter;
-    result.set_index(std::distance(slots_.begin(), slot_iter));
-    return result;
+    reverse_map_.emplace_back(free_list_.next);
+    return free_list_.acquire(slots_, value_pos);
   }
 
   //
@@ -319,6 +363,123 @@ public:
     return 1;
   }
 
+  /// Emplaces count values constructed from args and writes their keys to keys_out.
+  /// All the containers are grown once.
+  template <class OutputIt, class... Args>
+  constexpr OutputIt emplace_n(size_type count, OutputIt keys_out, const Args&... args) {
+    const size_type new_size = size() + count;
+    slot_map_detail::reserve_if_possible(values_, new_size);
+    slot_map_detail::reserve_if_possible(reverse_map_, new_size);
+    slot_map_detail::reserve_if_possible(slots_, std::max<size_type>(slots_.size(), new_size));
+
+    for (size_type i = 0; i < count; i++) {
+      *keys_out++ = emplace(args...);
+    }
+
+    return keys_out;
+  }
+
+  /// Erases all the valid keys with a single compaction pass.
+  /// Holes left below the new size are filled with the live values found above it,
+  /// so only the values that end up out of place are moved.
+  /// Expired and duplicated keys are ignored.
+  /// Returns the number of erased values.
+  constexpr size_type erase_keys(fst::span<const key_type> keys) {
+    std::vector<key_index_type> removed;
+    removed.reserve(keys.size());
+
+    for (const key_type& key : keys) {
+      auto slot_index = key.get_index();
+      if (slot_index >= slots_.size()) {
+        continue;
+      }
+
+      auto slot_iter = std::next(slots_.begin(), slot_index);
+      if (slot_iter->get_generation() != key.get_generation()) {
+        continue;
+      }
+
+      removed.push_back(slot_iter->get_index());
+
+      // Expiring right away makes duplicated keys fail the generation check.
+      free_list_.expire(slots_, static_cast<key_index_type>(slot_index));
+    }
+
+    if (removed.empty()) {
+      return 0;
+    }
+
+    std::sort(removed.begin(), removed.end());
+
+    const size_type new_size = size() - removed.size();
+    const auto holes_end = std::lower_bound(removed.begin(), removed.end(), static_cast<key_index_type>(new_size));
+    auto removed_tail_it = holes_end;
+    size_type src = new_size;
+
+    // Each hole below new_size takes the next live value at or above new_size.
+    for (auto removed_it = removed.begin(); removed_it != holes_end; ++removed_it) {
+      while (removed_tail_it != removed.end() && *removed_tail_it == src) {
+        ++removed_tail_it;
+        ++src;
+      }
+
+      const key_index_type dst = *removed_it;
+      *std::next(values_.begin(), dst) = std::move(*std::next(values_.begin(), src));
+
+      const key_index_type slot_index = *std::next(reverse_map_.begin(), src);
+      *std::next(reverse_map_.begin(), dst) = slot_index;
+      std::next(slots_.begin(), slot_index)->set_index(dst);
+      ++src;
+    }
+
+    values_.erase(std::next(values_.begin(), new_size), values_.end());
+    reverse_map_.erase(std::next(reverse_map_.begin(), new_size), reverse_map_.end());
+    return removed.size();
+  }
+
+  /// Sorts the values for iteration locality. Keys remain valid.
+  /// The values are permuted in place and slots_ and reverse_map_ are patched in one pass.
+  template <class Compare = std::less<>>
+  constexpr void sort(Compare comp = Compare()) {
+    const size_type count = size();
+    std::vector<key_index_type> order(count);
+    for (size_type i = 0; i < count; i++) {
+      order[i] = static_cast<key_index_type>(i);
+    }
+
+    std::sort(order.begin(), order.end(), [&](key_index_type a, key_index_type b) {
+      return comp(*std::next(values_.cbegin(), a), *std::next(values_.cbegin(), b));
+    });
+
+    // order[i] is the current index of the value that goes at index i, apply it cycle by cycle.
+    for (size_type i = 0; i < count; i++) {
+      if (order[i] == i) {
+        continue;
+      }
+
+      mapped_type value = std::move(*std::next(values_.begin(), i));
+      key_index_type rmap = *std::next(reverse_map_.begin(), i);
+      size_type dst = i;
+
+      while (order[dst] != i) {
+        const size_type src = order[dst];
+        *std::next(values_.begin(), dst) = std::move(*std::next(values_.begin(), src));
+        *std::next(reverse_map_.begin(), dst) = *std::next(reverse_map_.begin(), src);
+        order[dst] = static_cast<key_index_type>(dst);
+        dst = src;
+      }
+
+      *std::next(values_.begin(), dst) = std::move(value);
+      *std::next(reverse_map_.begin(), dst) = rmap;
+      order[dst] = static_cast<key_index_type>(dst);
+    }
+
+    auto rmap_it = reverse_map_.cbegin();
+    for (size_type i = 0; i < count; i++, ++rmap_it) {
+      std::next(slots_.begin(), *rmap_it)->set_index(i);
+    }
+  }
+
   /// clear() has O(n) time complexity and O(1) space complexity.
   /// It also has semantics differing from erase(begin(), end())
   /// in that it also resets the generation counter of every slot
@@ -328,8 +489,48 @@ public:
     slots_.clear();
     values_.clear();
     reverse_map_.clear();
-    next_available_slot_index_ = key_index_type{};
-    last_available_slot_index_ = key_index_type{};
+    free_list_.clear();
+  }
+
+  /// Raw view of the internal containers, used by the fst::binary_file snapshots.
+  /// Requires contiguous containers.
+  struct raw_state {
+    fst::span<const key_type> slots;
+    fst::span<const key_index_type> reverse_map;
+    fst::span<const mapped_type> values;
+    key_index_type next_available_slot_index;
+    key_index_type last_available_slot_index;
+  };
+
+  inline raw_state get_raw_state() const noexcept {
+    return raw_state{ fst::span<const key_type>(slots_.data(), slots_.size()),
+      fst::span<const key_index_type>(reverse_map_.data(), reverse_map_.size()),
+      fst::span<const mapped_type>(values_.data(), values_.size()), free_list_.next, free_list_.last };
+  }
+
+  /// Replaces the content with a state previously returned by get_raw_state().
+  /// The containers are copied in bulk, so the keys of the original map remain valid.
+  /// The raw data doesn't need to be aligned.
+  inline void set_raw_state(const void* slots, size_type slot_count, const void* reverse_map, const void* values,
+      size_type value_count, key_index_type next_available_slot_index, key_index_type last_available_slot_index) {
+    static_assert(std::is_trivially_copyable_v<mapped_type>, "slot_map::set_raw_state requires a trivially copyable type.");
+    static_assert(std::is_trivially_copyable_v<key_type>, "slot_map::set_raw_state requires a trivially copyable key.");
+
+    slots_.resize(slot_count);
+    reverse_map_.resize(value_count);
+    values_.resize(value_count);
+
+    if (slot_count) {
+      std::memcpy((void*)slots_.data(), slots, slot_count * sizeof(key_type));
+    }
+
+    if (value_count) {
+      std::memcpy((void*)reverse_map_.data(), reverse_map, value_count * sizeof(key_index_type));
+      std::memcpy((void*)values_.data(), values, value_count * sizeof(mapped_type));
+    }
+
+    free_list_.next = next_available_slot_index;
+    free_list_.last = last_available_slot_index;
   }
 
   /// swap is not mentioned in P0661r1 but it should be.
@@ -337,8 +538,7 @@ public:
     std::swap(slots_, rhs.slots_);
     std::swap(values_, rhs.values_);
     std::swap(reverse_map_, rhs.reverse_map_);
-    std::swap(next_available_slot_index_, rhs.next_available_slot_index_);
-    std::swap(last_available_slot_index_, rhs.last_available_slot_index_);
+    std::swap(free_list_, rhs.free_list_);
   }
 
 protected:
@@ -372,19 +572,7 @@ private:
 
     values_.pop_back();
     reverse_map_.pop_back();
-
-    // Expire this key.
-    if (next_available_slot_index_ == slots_.size()) {
-      next_available_slot_index_ = static_cast<key_index_type>(slot_index);
-      last_available_slot_index_ = static_cast<key_index_type>(slot_index);
-    }
-    else {
-      auto last_slot_iter = std::next(slots_.begin(), last_available_slot_index_);
-      last_slot_iter->set_index(slot_index);
-      last_available_slot_index_ = static_cast<key_index_type>(slot_index);
-    }
-
-    slot_iter->increment_generation();
+    free_list_.expire(slots_, static_cast<key_index_type>(slot_index));
     return std::next(values_.begin(), value_index);
   }
 
@@ -397,21 +585,212 @@ private:
   // exactly size() entries.
   Container<mapped_type> values_;
 
-  key_index_type next_available_slot_index_{};
-  key_index_type last_available_slot_index_{};
-
-  // Class invariant:
-  // Either next_available_slot_index_ == last_available_slot_index_ == slots_.size(),
-  // or else 0 <= next_available_slot_index_ < slots_.size() and the "key" of that slot
-  // entry points to the subsequent available slot, and so on, until reaching
-  // last_available_slot_index_ (which might equal next_available_slot_index_ if there
-  // is only one available slot at the moment).
+  // Class invariant: see slot_map_detail::slot_free_list.
+  slot_map_detail::slot_free_list<key_type> free_list_;
 };
 
 template <class T, class Key, template <class...> class Container>
 constexpr void swap(slot_map<T, Key, Container>& lhs, slot_map<T, Key, Container>& rhs) {
   lhs.swap(rhs);
 }
+
+/// soa_slot_map
+///
+/// Structure of arrays version of slot_map.
+/// The slots_ and reverse_map_ bookkeeping is the same as slot_map, but each field
+/// is stored in its own dense column so systems only walk the fields they touch.
+///
+/// All the columns are kept in the same order, column<I>()[i] and key_at(i) refer to the same element.
+/// @code
+///   fst::soa_slot_map<position, velocity, name> entities;
+///   auto key = entities.emplace(position{}, velocity{}, "bingo");
+///
+///   auto [pos, vel] = entities.columns<0, 1>();
+///   for (std::size_t i = 0; i < pos.size(); i++) {
+///     pos[i] += vel[i];
+///   }
+/// @endcode
+template <class... Ts>
+class soa_slot_map {
+  static_assert(sizeof...(Ts) > 0, "soa_slot_map requires at least one column.");
+
+public:
+  using key_type = slot_map_key<unsigned int, unsigned int>;
+  using key_index_type = typename key_type::index_type;
+  using key_generation_type = typename key_type::generation_type;
+  using size_type = std::size_t;
+
+  template <size_type I>
+  using column_type = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+  static constexpr size_type column_count = sizeof...(Ts);
+  static constexpr size_type npos = (size_type)-1;
+
+  soa_slot_map() = default;
+  soa_slot_map(const soa_slot_map&) = default;
+  soa_slot_map(soa_slot_map&&) = default;
+  soa_slot_map& operator=(const soa_slot_map&) = default;
+  soa_slot_map& operator=(soa_slot_map&&) = default;
+  ~soa_slot_map() = default;
+
+  inline bool empty() const noexcept { return reverse_map_.empty(); }
+  inline size_type size() const noexcept { return reverse_map_.size(); }
+  inline size_type slot_count() const noexcept { return slots_.size(); }
+
+  inline void reserve(size_type n) {
+    std::apply([n](auto&... cols) { (cols.reserve(n), ...); }, columns_);
+    reverse_map_.reserve(n);
+    slots_.reserve(n);
+  }
+
+  /// Takes one value per column.
+  template <class... Args>
+  inline key_type emplace(Args&&... args) {
+    static_assert(sizeof...(Args) == column_count, "soa_slot_map::emplace requires one value per column.");
+
+    const size_type value_pos = reverse_map_.size();
+    emplace_columns(std::index_sequence_for<Ts...>{}, std::forward<Args>(args)...);
+    reverse_map_.push_back(free_list_.next);
+    return free_list_.acquire(slots_, value_pos);
+  }
+
+  /// Returns the dense index of the key or npos.
+  inline size_type index_of(const key_type& key) const noexcept {
+    if (key.get_index() >= slots_.size() || slots_[key.get_index()].get_generation() != key.get_generation()) {
+      return npos;
+    }
+
+    return slots_[key.get_index()].get_index();
+  }
+
+  inline bool contains(const key_type& key) const noexcept { return index_of(key) != npos; }
+
+  /// Key of the element at the dense index.
+  inline key_type key_at(size_type index) const noexcept {
+    fst_assert(index < size(), "soa_slot_map::key_at : Out of range.");
+    const key_index_type slot_index = reverse_map_[index];
+    return key_type{ slot_index, slots_[slot_index].get_generation() };
+  }
+
+  /// Checked access, throws if the key is expired.
+  template <size_type I>
+  inline column_type<I>& at(const key_type& key) {
+    const size_type index = index_of(key);
+    if (index == npos) {
+      FST_SLOT_MAP_THROW_OUT_OF_RANGE_EXCEPTION();
+    }
+    return std::get<I>(columns_)[index];
+  }
+
+  template <size_type I>
+  inline const column_type<I>& at(const key_type& key) const {
+    const size_type index = index_of(key);
+    if (index == npos) {
+      FST_SLOT_MAP_THROW_OUT_OF_RANGE_EXCEPTION();
+    }
+    return std::get<I>(columns_)[index];
+  }
+
+  /// Returns nullptr if the key is expired.
+  template <size_type I>
+  inline column_type<I>* find(const key_type& key) noexcept {
+    const size_type index = index_of(key);
+    return index == npos ? nullptr : &std::get<I>(columns_)[index];
+  }
+
+  template <size_type I>
+  inline const column_type<I>* find(const key_type& key) const noexcept {
+    const size_type index = index_of(key);
+    return index == npos ? nullptr : &std::get<I>(columns_)[index];
+  }
+
+  /// Dense column.
+  template <size_type I>
+  inline fst::span<column_type<I>> column() noexcept {
+    return fst::span<column_type<I>>(std::get<I>(columns_).data(), size());
+  }
+
+  template <size_type I>
+  inline fst::span<const column_type<I>> column() const noexcept {
+    return fst::span<const column_type<I>>(std::get<I>(columns_).data(), size());
+  }
+
+  /// Tuple of dense columns, meant for structured bindings.
+  template <size_type... Is>
+  inline std::tuple<fst::span<column_type<Is>>...> columns() noexcept {
+    return { column<Is>()... };
+  }
+
+  template <size_type... Is>
+  inline std::tuple<fst::span<const column_type<Is>>...> columns() const noexcept {
+    return { column<Is>()... };
+  }
+
+  inline size_type erase(const key_type& key) {
+    const size_type index = index_of(key);
+    if (index == npos) {
+      return 0;
+    }
+
+    erase_at(index);
+    return 1;
+  }
+
+  /// Erases the element at the dense index, the last element is moved in its place.
+  inline void erase_at(size_type value_index) {
+    fst_assert(value_index < size(), "soa_slot_map::erase_at : Out of range.");
+
+    const key_index_type slot_index = reverse_map_[value_index];
+    const size_type back_index = size() - 1;
+
+    if (value_index != back_index) {
+      std::apply([&](auto&... cols) { ((cols[value_index] = std::move(cols[back_index])), ...); }, columns_);
+      const key_index_type back_slot_index = reverse_map_[back_index];
+      slots_[back_slot_index].set_index(value_index);
+      reverse_map_[value_index] = back_slot_index;
+    }
+
+    std::apply([](auto&... cols) { (cols.pop_back(), ...); }, columns_);
+    reverse_map_.pop_back();
+    free_list_.expire(slots_, slot_index);
+  }
+
+  inline void clear() {
+    std::apply([](auto&... cols) { (cols.clear(), ...); }, columns_);
+    slots_.clear();
+    reverse_map_.clear();
+    free_list_.clear();
+  }
+
+  inline void swap(soa_slot_map& rhs) {
+    std::swap(slots_, rhs.slots_);
+    std::swap(reverse_map_, rhs.reverse_map_);
+    std::swap(columns_, rhs.columns_);
+    std::swap(free_list_, rhs.free_list_);
+  }
+
+private:
+  template <size_type... Is, class... Args>
+  inline void emplace_columns(std::index_sequence<Is...>, Args&&... args) {
+    (std::get<Is>(columns_).emplace_back(std::forward<Args>(args)), ...);
+  }
+
+  // high_water_mark() entries.
+  std::vector<key_type> slots_;
+
+  // exactly size() entries.
+  std::vector<key_index_type> reverse_map_;
+
+  // exactly size() entries per column.
+  std::tuple<std::vector<Ts>...> columns_;
+
+  slot_map_detail::slot_free_list<key_type> free_list_;
+};
+
+template <class... Ts>
+inline void swap(soa_slot_map<Ts...>& lhs, soa_slot_map<Ts...>& rhs) {
+  lhs.swap(rhs);
+}
 } // namespace fst
 
 #undef FST_SLOT_MAP_THROW_OUT_OF_RANGE_EXCEPTION
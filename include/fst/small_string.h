@@ -126,7 +126,7 @@ public:
     _size = std::distance(first, last);
     fst_assert(
         _size <= maximum_size, "basic_small_string iteration distance must be smaller or equal to maximum_size.");
-    std::copy_n(first, last, _data.data());
+    std::copy(first, last, _data.data());
     _data[_size] = 0;
   }
 
@@ -134,14 +134,14 @@ public:
     fst_assert(ilist.size() <= maximum_size,
         "basic_small_string initializer_list size must be smaller or equal to maximum_size.");
     _size = ilist.size();
-    std::copy_n(ilist.begin(), ilist.end(), _data.data());
+    std::copy_n(ilist.begin(), _size, _data.data());
     _data[_size] = 0;
   }
 
   inline constexpr basic_small_string(view_type v) noexcept {
     fst_assert(v.size() <= maximum_size, "basic_small_string view size must be smaller or equal to maximum_size.");
     _size = v.size();
-    std::copy_n(v.begin(), v.end(), _data.data());
+    std::copy_n(v.begin(), _size, _data.data());
     _data[_size] = 0;
   }
 
@@ -201,7 +201,7 @@ public:
     fst_assert(ilist.size() <= maximum_size,
         "basic_small_string initializer_list size must be smaller or equal to maximum_size.");
     _size = ilist.size();
-    std::copy_n(ilist.begin(), ilist.end(), _data.data());
+    std::copy_n(ilist.begin(), _size, _data.data());
     _data[_size] = 0;
     return *this;
   }
@@ -32,13 +32,29 @@
 ///
 
 #pragma once
+#include <fst/config>
+#include <fst/assert>
 #include <atomic>
+#include <cstdint>
+#include <thread>
 
 // https://livebook.manning.com/book/c-plus-plus-concurrency-in-action/chapter-7/7
+// https://www.akkadia.org/drepper/futex.pdf
 
 namespace fst {
+/// spin_lock_mutex
+///
+/// Adaptive lock: spins for a while, then parks the thread with std::atomic::wait.
+///
+/// The spinning is test-and-test-and-set (waiters only read the state until it looks free)
+/// with a pause instruction and an exponential backoff. After spin_count attempts, the state
+/// is marked as contended and the thread waits on it, unlock() only notifies when a thread
+/// may be waiting.
 class spin_lock_mutex {
 public:
+  static constexpr std::uint32_t spin_count = 64;
+  static constexpr std::uint32_t maximum_pause_count = 64;
+
   spin_lock_mutex() noexcept = default;
   ~spin_lock_mutex() noexcept = default;
 
@@ -49,14 +65,236 @@ public:
   spin_lock_mutex& operator=(spin_lock_mutex&&) = delete;
 
   inline void lock() noexcept {
-    while (_flag.test_and_set(std::memory_order_acquire))
-      ;
+    if (FST_LIKELY(try_lock())) {
+      return;
+    }
+
+    lock_contended();
+  }
+
+  inline bool try_lock() noexcept {
+    std::uint32_t expected = unlocked;
+    return _state.load(std::memory_order_relaxed) == unlocked
+        && _state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  inline void unlock() noexcept {
+    if (_state.exchange(unlocked, std::memory_order_release) == contended) {
+      _state.notify_one();
+    }
+  }
+
+private:
+  enum : std::uint32_t { unlocked, locked, contended };
+  std::atomic<std::uint32_t> _state = unlocked;
+
+  inline void lock_contended() noexcept {
+    std::uint32_t pause_count = 1;
+
+    for (std::uint32_t i = 0; i < spin_count; i++) {
+      for (std::uint32_t k = 0; k < pause_count; k++) {
+        FST_NOP();
+      }
+
+      pause_count = pause_count < maximum_pause_count ? pause_count * 2 : maximum_pause_count;
+
+      if (try_lock()) {
+        return;
+      }
+    }
+
+    // Park. The state stays contended while a thread may be waiting, so that unlock() notifies.
+    while (_state.exchange(contended, std::memory_order_acquire) != unlocked) {
+      _state.wait(contended, std::memory_order_relaxed);
+    }
+  }
+};
+
+/// shared_spin_lock
+///
+/// Reader-writer spin lock with writer priority.
+///
+/// Any number of readers can hold the lock at once. A writer announces itself before waiting
+/// for the readers to leave, and new readers back off while a writer is pending, so a steady
+/// stream of readers can't starve writers. The lock is not reentrant: taking a shared lock
+/// twice on the same thread can deadlock if a writer comes in between.
+///
+/// Like spin_lock_mutex, waiters spin with a backoff and then park with std::atomic::wait.
+class shared_spin_lock {
+public:
+  static constexpr std::uint32_t spin_count = 64;
+  static constexpr std::uint32_t maximum_pause_count = 64;
+  static constexpr std::uint32_t maximum_readers = 0x7FFF;
+
+  shared_spin_lock() noexcept = default;
+  ~shared_spin_lock() noexcept = default;
+
+  shared_spin_lock(const shared_spin_lock&) = delete;
+  shared_spin_lock(shared_spin_lock&&) = delete;
+
+  shared_spin_lock& operator=(const shared_spin_lock&) = delete;
+  shared_spin_lock& operator=(shared_spin_lock&&) = delete;
+
+  inline void lock() noexcept {
+    if (FST_LIKELY(try_lock())) {
+      return;
+    }
+
+    _state.fetch_add(pending_writer_one, std::memory_order_relaxed);
+    wait_for([this]() noexcept { return try_lock_pending(); }, writer_mask | readers_mask);
+  }
+
+  inline bool try_lock() noexcept {
+    std::uint32_t s = _state.load(std::memory_order_relaxed);
+    return (s & (writer_mask | readers_mask)) == 0
+        && _state.compare_exchange_strong(s, s | writer_mask, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  inline void unlock() noexcept {
+    if (_state.fetch_and(~writer_mask, std::memory_order_release) & parked_mask) {
+      wake_all();
+    }
+  }
+
+  inline void lock_shared() noexcept {
+    if (FST_LIKELY(try_lock_shared())) {
+      return;
+    }
+
+    wait_for([this]() noexcept { return try_lock_shared(); }, writer_mask | pending_writers_mask);
+  }
+
+  inline bool try_lock_shared() noexcept {
+    std::uint32_t s = _state.load(std::memory_order_relaxed);
+    while ((s & (writer_mask | pending_writers_mask)) == 0) {
+      fst_assert((s & readers_mask) < maximum_readers, "Too many readers");
+
+      if (_state.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+
+    return false;
   }
 
-  inline void unlock() noexcept { _flag.clear(std::memory_order_release); }
+  inline void unlock_shared() noexcept {
+    // Only writers wait on readers, they only need to be woken by the last one.
+    const std::uint32_t s = _state.fetch_sub(1, std::memory_order_release);
+    if ((s & readers_mask) == 1 && (s & parked_mask)) {
+      wake_all();
+    }
+  }
 
 private:
-  std::atomic_flag _flag = ATOMIC_FLAG_INIT;
+  // [31] writer, [16, 30] pending writers, [15] parked, [0, 14] readers.
+  static constexpr std::uint32_t readers_mask = maximum_readers;
+  static constexpr std::uint32_t parked_mask = 1u << 15;
+  static constexpr std::uint32_t pending_writer_one = 1u << 16;
+  static constexpr std::uint32_t pending_writers_mask = 0x7FFFu << 16;
+  static constexpr std::uint32_t writer_mask = 1u << 31;
+
+  std::atomic<std::uint32_t> _state = 0;
+
+  inline bool try_lock_pending() noexcept {
+    std::uint32_t s = _state.load(std::memory_order_relaxed);
+    return (s & (writer_mask | readers_mask)) == 0
+        && _state.compare_exchange_strong(
+            s, (s - pending_writer_one) | writer_mask, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  inline void wake_all() noexcept {
+    _state.fetch_and(~parked_mask, std::memory_order_relaxed);
+    _state.notify_all();
+  }
+
+  /// Calls try_acquire until it succeeds. blocking_mask is the set of bits that makes it fail.
+  template <class _Fct>
+  inline void wait_for(_Fct try_acquire, std::uint32_t blocking_mask) noexcept {
+    std::uint32_t pause_count = 1;
+
+    for (std::uint32_t i = 0; i < spin_count; i++) {
+      for (std::uint32_t k = 0; k < pause_count; k++) {
+        FST_NOP();
+      }
+
+      pause_count = pause_count < maximum_pause_count ? pause_count * 2 : maximum_pause_count;
+
+      if (try_acquire()) {
+        return;
+      }
+    }
+
+    while (!try_acquire()) {
+      // Park. The parked bit makes the next release notify, the wait returns right away if the
+      // state changed in between.
+      std::uint32_t s = _state.load(std::memory_order_relaxed);
+      if ((s & blocking_mask) && _state.compare_exchange_weak(s, s | parked_mask, std::memory_order_relaxed)) {
+        _state.wait(s | parked_mask, std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+/// ticket_spin_lock
+///
+/// Fair spin lock, threads get the lock in the order they asked for it.
+///
+/// Each waiter takes a ticket and spins until it is served, pausing in proportion to its
+/// distance from the head of the queue. Waiters yield their time slice after spin_count
+/// attempts but never park, a parked thread holding the next ticket would stall everyone
+/// behind it. Best suited to short critical sections with no more threads than cores.
+class ticket_spin_lock {
+public:
+  static constexpr std::uint32_t spin_count = 16;
+  static constexpr std::uint32_t pause_per_ticket = 8;
+  static constexpr std::uint32_t maximum_pause_count = 64;
+
+  ticket_spin_lock() noexcept = default;
+  ~ticket_spin_lock() noexcept = default;
+
+  ticket_spin_lock(const ticket_spin_lock&) = delete;
+  ticket_spin_lock(ticket_spin_lock&&) = delete;
+
+  ticket_spin_lock& operator=(const ticket_spin_lock&) = delete;
+  ticket_spin_lock& operator=(ticket_spin_lock&&) = delete;
+
+  inline void lock() noexcept {
+    const std::uint32_t ticket = _next_ticket.fetch_add(1, std::memory_order_relaxed);
+
+    for (std::uint32_t i = 0;; i++) {
+      const std::uint32_t serving = _now_serving.load(std::memory_order_acquire);
+      if (serving == ticket) {
+        return;
+      }
+
+      if (i < spin_count) {
+        const std::uint32_t distance = ticket - serving;
+        const std::uint32_t pause_count
+            = distance < maximum_pause_count / pause_per_ticket ? distance * pause_per_ticket : maximum_pause_count;
+        for (std::uint32_t k = 0; k < pause_count; k++) {
+          FST_NOP();
+        }
+      }
+      else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  inline bool try_lock() noexcept {
+    std::uint32_t ticket = _now_serving.load(std::memory_order_relaxed);
+    return _next_ticket.compare_exchange_strong(
+        ticket, ticket + 1, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  inline void unlock() noexcept {
+    // Only the owner writes _now_serving.
+    _now_serving.store(_now_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+private:
+  std::atomic<std::uint32_t> _next_ticket = 0;
+  std::atomic<std::uint32_t> _now_serving = 0;
 };
 
 class scoped_spin_lock {
@@ -77,4 +315,61 @@ public:
 private:
   spin_lock_mutex& _mutex;
 };
+
+class scoped_read_lock {
+public:
+  inline scoped_read_lock(shared_spin_lock& mutex)
+      : _mutex(mutex) {
+    _mutex.lock_shared();
+  }
+
+  inline ~scoped_read_lock() { _mutex.unlock_shared(); }
+
+  scoped_read_lock(const scoped_read_lock&) = delete;
+  scoped_read_lock(scoped_read_lock&&) = delete;
+
+  scoped_read_lock& operator=(const scoped_read_lock&) = delete;
+  scoped_read_lock& operator=(scoped_read_lock&&) = delete;
+
+private:
+  shared_spin_lock& _mutex;
+};
+
+class scoped_write_lock {
+public:
+  inline scoped_write_lock(shared_spin_lock& mutex)
+      : _mutex(mutex) {
+    _mutex.lock();
+  }
+
+  inline ~scoped_write_lock() { _mutex.unlock(); }
+
+  scoped_write_lock(const scoped_write_lock&) = delete;
+  scoped_write_lock(scoped_write_lock&&) = delete;
+
+  scoped_write_lock& operator=(const scoped_write_lock&) = delete;
+  scoped_write_lock& operator=(scoped_write_lock&&) = delete;
+
+private:
+  shared_spin_lock& _mutex;
+};
+
+class scoped_ticket_lock {
+public:
+  inline scoped_ticket_lock(ticket_spin_lock& mutex)
+      : _mutex(mutex) {
+    _mutex.lock();
+  }
+
+  inline ~scoped_ticket_lock() { _mutex.unlock(); }
+
+  scoped_ticket_lock(const scoped_ticket_lock&) = delete;
+  scoped_ticket_lock(scoped_ticket_lock&&) = delete;
+
+  scoped_ticket_lock& operator=(const scoped_ticket_lock&) = delete;
+  scoped_ticket_lock& operator=(scoped_ticket_lock&&) = delete;
+
+private:
+  ticket_spin_lock& _mutex;
+};
 } // namespace fst.
@@ -3,6 +3,7 @@
 #include <fst/print>
 #include <fst/span>
 #include <array>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -116,4 +117,317 @@ TEST(allocator, std4) {
     EXPECT_EQ(buffer1[i] * 2, buffer2[i]);
   }
 }
+
+TEST(allocator, concurrent_pool) {
+  using pool_allocator_type = fst::concurrent_memory_pool_allocator<>;
+  using allocator_type = fst::allocator<int, pool_allocator_type>;
+
+  pool_allocator_type pool(1024);
+  EXPECT_EQ(pool.is_freeable, false);
+  EXPECT_EQ(pool.is_ref_counted, true);
+  EXPECT_FALSE(pool.is_shared());
+
+  {
+    std::vector<int, allocator_type> buffer((pool));
+    EXPECT_TRUE(pool.is_shared());
+
+    buffer.resize(64);
+    for (std::size_t i = 0; i < buffer.size(); i++) {
+      buffer[i] = (int)i;
+    }
+
+    for (std::size_t i = 0; i < buffer.size(); i++) {
+      EXPECT_EQ((int)i, buffer[i]);
+    }
+  }
+
+  EXPECT_FALSE(pool.is_shared());
+
+  // Larger than the chunk size.
+  void* big = pool.allocate(4096);
+  EXPECT_NE(big, nullptr);
+  EXPECT_GE(pool.capacity(), 4096);
+
+  pool.clear();
+  EXPECT_EQ(pool.size(), 0);
+  EXPECT_EQ(pool.capacity() % 1024, 0);
+}
+
+TEST(allocator, concurrent_pool_realloc) {
+  fst::concurrent_memory_pool_allocator<> pool(1024);
+
+  int* data = static_cast<int*>(pool.allocate(4 * sizeof(int)));
+  data[0] = 32;
+  int* grown = static_cast<int*>(pool.realloc(data, 4 * sizeof(int), 8 * sizeof(int)));
+  EXPECT_EQ(data, grown);
+
+  // Not the last block anymore.
+  void* other = pool.allocate(8);
+  EXPECT_NE(other, nullptr);
+  grown = static_cast<int*>(pool.realloc(data, 8 * sizeof(int), 16 * sizeof(int)));
+  EXPECT_NE(data, grown);
+  EXPECT_EQ(grown[0], 32);
+}
+
+TEST(allocator, concurrent_pool_threads) {
+  using pool_allocator_type = fst::concurrent_memory_pool_allocator<>;
+
+  constexpr std::size_t n_threads = 8;
+  constexpr std::size_t n_alloc = 2000;
+
+  pool_allocator_type pool(512);
+  pool.reserve(4);
+
+  std::vector<std::vector<std::size_t*>> results(n_threads);
+  std::vector<std::thread> threads;
+
+  for (std::size_t t = 0; t < n_threads; t++) {
+    threads.emplace_back([t, &results, p = pool]() mutable {
+      for (std::size_t i = 0; i < n_alloc; i++) {
+        std::size_t count = 1 + (i % 7);
+        std::size_t* data = static_cast<std::size_t*>(p.allocate(count * sizeof(std::size_t)));
+        for (std::size_t k = 0; k < count; k++) {
+          data[k] = t * n_alloc + i;
+        }
+        results[t].push_back(data);
+      }
+    });
+  }
+
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  EXPECT_FALSE(pool.is_shared());
+
+  for (std::size_t t = 0; t < n_threads; t++) {
+    for (std::size_t i = 0; i < n_alloc; i++) {
+      std::size_t count = 1 + (i % 7);
+      for (std::size_t k = 0; k < count; k++) {
+        EXPECT_EQ(results[t][i][k], t * n_alloc + i);
+      }
+    }
+  }
+}
+
+TEST(allocator, size_class_pool) {
+  using pool_allocator_type = fst::size_class_pool_allocator<>;
+
+  pool_allocator_type pool(1024);
+  EXPECT_EQ(pool.is_freeable, true);
+  EXPECT_EQ(pool.is_ref_counted, true);
+
+  void* a = pool.allocate(24);
+  void* b = pool.allocate(20);
+  EXPECT_NE(a, b);
+
+  // Freed blocks are reused by the same size class.
+  pool.free(a, 24);
+  EXPECT_EQ(pool.allocate(17), a);
+
+  // Same size class, not moved.
+  EXPECT_EQ(pool.realloc(b, 20, 24), b);
+
+  // Large blocks go to the base allocator.
+  void* large = pool.allocate(pool_allocator_type::max_small_size + 1);
+  EXPECT_NE(large, nullptr);
+  pool.free(large, pool_allocator_type::max_small_size + 1);
+  EXPECT_EQ(pool.capacity(), 1024);
+}
+
+TEST(allocator, size_class_pool_reuse) {
+  using pool_allocator_type = fst::size_class_pool_allocator<>;
+
+  pool_allocator_type pool(4096);
+
+  {
+    std::vector<int, fst::allocator<int, pool_allocator_type>> buffer((pool));
+    EXPECT_TRUE(pool.is_shared());
+
+    for (int k = 0; k < 100; k++) {
+      for (int i = 0; i < 60; i++) {
+        buffer.push_back(i);
+      }
+
+      EXPECT_EQ(buffer[59], 59);
+      buffer.clear();
+      buffer.shrink_to_fit();
+    }
+  }
+
+  EXPECT_FALSE(pool.is_shared());
+
+  // The growth history of the vector was recycled.
+  EXPECT_EQ(pool.capacity(), 4096);
+}
+
+TEST(allocator, pool_rewind) {
+  using pool_allocator_type = fst::memory_pool_allocator<>;
+
+  pool_allocator_type pool(256);
+  pool_allocator_type::marker m = pool.mark();
+
+  void* a = pool.allocate(64);
+  EXPECT_NE(a, nullptr);
+  EXPECT_EQ(pool.size(), 64);
+
+  {
+    fst::scoped_arena_frame<pool_allocator_type> frame(pool);
+
+    // Forces new chunks.
+    for (int i = 0; i < 10; i++) {
+      EXPECT_NE(pool.allocate(128), nullptr);
+    }
+
+    {
+      fst::scoped_arena_frame<pool_allocator_type> nested_frame(pool);
+      EXPECT_NE(pool.allocate(32), nullptr);
+    }
+
+    EXPECT_EQ(pool.size(), 64 + 10 * 128);
+  }
+
+  EXPECT_EQ(pool.size(), 64);
+  EXPECT_EQ(pool.allocate(8), static_cast<std::uint8_t*>(a) + 64);
+
+  // Back to the initial empty chunk.
+  pool.rewind(m);
+  EXPECT_EQ(pool.size(), 0);
+  EXPECT_EQ(pool.capacity(), 0);
+}
+
+#if __FST_LINUX__
+TEST(allocator, huge_page) {
+  using base_allocator_type = fst::huge_page_allocator<>;
+  using pool_allocator_type = fst::memory_pool_allocator<base_allocator_type>;
+
+  base_allocator_type base;
+  constexpr std::size_t huge_page_size = base_allocator_type::huge_page_size;
+
+  void* small = base.allocate(64);
+  EXPECT_NE(small, nullptr);
+  base.free(small);
+
+  std::uint8_t* data = static_cast<std::uint8_t*>(base.allocate(huge_page_size + 10));
+  EXPECT_NE(data, nullptr);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(data) % huge_page_size, 0);
+  data[0] = 1;
+  data[2 * huge_page_size - 1] = 2;
+
+  data = static_cast<std::uint8_t*>(base.realloc(data, huge_page_size + 10, 3 * huge_page_size));
+  EXPECT_EQ(data[0], 1);
+  EXPECT_EQ(base.realloc(data, 3 * huge_page_size, 0), nullptr);
+
+  // Chunks fill the huge pages.
+  pool_allocator_type pool;
+  EXPECT_NE(pool.allocate(128), nullptr);
+  EXPECT_LT(pool.capacity(), huge_page_size);
+  EXPECT_GT(pool.capacity(), huge_page_size - 64);
+
+  std::vector<int, fst::allocator<int, pool_allocator_type>> buffer((pool));
+  buffer.resize(1024 * 1024);
+  buffer.back() = 32;
+  EXPECT_EQ(buffer.back(), 32);
+}
+
+TEST(allocator, huge_page_numa) {
+  fst::huge_page_allocator<0> base;
+  std::uint8_t* data = static_cast<std::uint8_t*>(base.allocate(fst::huge_page_allocator<0>::huge_page_size));
+  EXPECT_NE(data, nullptr);
+  data[0] = 1;
+  base.free(data);
+}
+#endif // __FST_LINUX__
+
+TEST(allocator, pool_stats) {
+  using pool_allocator_type = fst::memory_pool_allocator<fst::crt_allocator, fst::allocator_stats_counter>;
+
+  pool_allocator_type pool(256);
+  EXPECT_EQ(pool.get_stats().chunk_count, 1);
+
+  pool_allocator_type::marker m = pool.mark();
+  EXPECT_NE(pool.allocate(10), nullptr);
+  EXPECT_NE(pool.allocate(200), nullptr);
+
+  fst::allocator_stats stats = pool.get_stats();
+  EXPECT_EQ(stats.allocation_count, 2);
+  EXPECT_EQ(stats.chunk_count, 2);
+  EXPECT_EQ(stats.size, 16 + 200);
+  EXPECT_EQ(stats.alignment_waste, 6);
+  EXPECT_EQ(stats.capacity, 256);
+  EXPECT_EQ(pool.size(), 216);
+  EXPECT_EQ(pool.capacity(), 256);
+
+  EXPECT_NE(pool.allocate(300), nullptr);
+  EXPECT_EQ(pool.get_stats().chunk_count, 3);
+  EXPECT_EQ(pool.capacity(), 256 + 304);
+
+  pool.rewind(m);
+  stats = pool.get_stats();
+  EXPECT_EQ(stats.size, 0);
+  EXPECT_EQ(stats.peak_size, 16 + 200 + 304);
+  EXPECT_EQ(stats.chunk_count, 1);
+  EXPECT_EQ(stats.capacity, 0);
+
+  EXPECT_NE(pool.allocate(64), nullptr);
+  pool.clear();
+  EXPECT_EQ(pool.size(), 0);
+  EXPECT_EQ(pool.get_stats().allocation_count, 4);
+}
+
+TEST(allocator, allocator_stats) {
+  using allocator_type = fst::allocator<int, fst::crt_allocator, fst::allocator_stats_counter>;
+
+  fst::allocator_stats_counter counter;
+
+  {
+    std::vector<int, allocator_type> buffer(allocator_type(fst::crt_allocator(), counter));
+    buffer.resize(64);
+    EXPECT_EQ(counter.get_stats().allocation_count, 1);
+    EXPECT_EQ(counter.get_stats().size, 64 * sizeof(int));
+  }
+
+  EXPECT_EQ(counter.get_stats().deallocation_count, 1);
+  EXPECT_EQ(counter.get_stats().size, 0);
+  EXPECT_EQ(counter.get_stats().peak_size, 64 * sizeof(int));
+
+  // Disabled policy has no overhead.
+  EXPECT_EQ(sizeof(fst::allocator<int>), sizeof(std::allocator<int>));
+}
+
+TEST(allocator, over_aligned) {
+  struct alignas(32) simd_type {
+    float data[8];
+  };
+
+  struct alignas(64) padded_counter {
+    int value;
+  };
+
+  using pool_allocator_type = fst::memory_pool_allocator<>;
+
+  pool_allocator_type pool(1024);
+  EXPECT_NE(pool.allocate(4), nullptr);
+
+  void* data = pool.allocate(24, 128);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(data) % 128, 0);
+
+  std::vector<simd_type, fst::allocator<simd_type, pool_allocator_type>> simd_buffer((pool));
+  std::vector<padded_counter, fst::allocator<padded_counter, pool_allocator_type>> counters((pool));
+
+  for (int i = 0; i < 100; i++) {
+    simd_buffer.push_back(simd_type{ { (float)i } });
+    counters.push_back(padded_counter{ i });
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(simd_buffer.data()) % alignof(simd_type), 0);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(counters.data()) % alignof(padded_counter), 0);
+  }
+
+  EXPECT_EQ(simd_buffer[99].data[0], 99.0f);
+  EXPECT_EQ(counters[99].value, 99);
+
+#if __FST_UNISTD__
+  std::vector<padded_counter, fst::allocator<padded_counter>> crt_counters(10);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(crt_counters.data()) % alignof(padded_counter), 0);
+#endif // __FST_UNISTD__
+}
 } // namespace
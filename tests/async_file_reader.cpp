@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include "fst/async_file_reader.h"
+#include "fst/mapped_file.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <vector>
+
+namespace {
+class async_file_reader_test : public ::testing::TestWithParam<bool> {
+protected:
+  static constexpr std::size_t value_count = 200000;
+
+  void SetUp() override {
+    _path = std::filesystem::temp_directory_path() / "fst_async_file_reader.bin";
+
+    fst::writable_mapped_file file;
+    ASSERT_TRUE(file.create(_path, value_count * sizeof(std::uint32_t)));
+    for (std::uint32_t i = 0; i < value_count; i++) {
+      std::memcpy(file.data() + i * sizeof(std::uint32_t), &i, sizeof(std::uint32_t));
+    }
+  }
+
+  void TearDown() override { std::filesystem::remove(_path); }
+
+  static bool check(const fst::async_file_reader::completion& c) {
+    if (!c.ok() || c.offset % sizeof(std::uint32_t)) {
+      return false;
+    }
+
+    const std::size_t first = c.offset / sizeof(std::uint32_t);
+    for (std::size_t i = 0; i < c.view().size() / sizeof(std::uint32_t); i++) {
+      if (c.view().as<std::uint32_t>(i * sizeof(std::uint32_t)) != first + i) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  std::filesystem::path _path;
+};
+
+TEST_P(async_file_reader_test, futures) {
+  fst::async_file_reader::options opts;
+  opts.buffer_size = 64 * 1024;
+  opts.buffer_count = 8;
+  opts.use_io_uring = GetParam();
+
+  fst::async_file_reader reader;
+  ASSERT_TRUE(reader.open(_path, opts));
+  EXPECT_NE(reader.backend(), fst::async_file_reader::backend_type::none);
+  EXPECT_EQ(reader.file_size(), value_count * sizeof(std::uint32_t));
+
+  std::vector<std::future<fst::async_file_reader::completion>> futures;
+  for (std::size_t i = 0; i < 6; i++) {
+    futures.push_back(reader.read(i * 30000 * sizeof(std::uint32_t), 4096 * (i + 1)));
+  }
+
+  for (auto& f : futures) {
+    fst::async_file_reader::completion c = f.get();
+    EXPECT_TRUE(c.ok());
+    EXPECT_TRUE(check(c));
+  }
+
+  // Past the end of the file.
+  fst::async_file_reader::completion c = reader.read(reader.file_size() - 8, 4096).get();
+  EXPECT_TRUE(c.ok());
+  EXPECT_EQ(c.view().size(), 8);
+  EXPECT_TRUE(check(c));
+
+  c = reader.read(reader.file_size(), 4096).get();
+  EXPECT_TRUE(c.ok());
+  EXPECT_TRUE(c.view().empty());
+
+  // Larger than a buffer.
+  c = reader.read(0, opts.buffer_size + 1).get();
+  EXPECT_EQ(c.error, EINVAL);
+}
+
+TEST_P(async_file_reader_test, callbacks) {
+  fst::async_file_reader::options opts;
+  opts.buffer_size = 16 * 1024;
+  opts.buffer_count = 4;
+  opts.use_io_uring = GetParam();
+
+  fst::async_file_reader reader;
+  ASSERT_TRUE(reader.open(_path, opts));
+
+  // Many more reads than buffers, read() waits for buffers to come back.
+  std::atomic<std::size_t> bytes = 0;
+  std::atomic<std::size_t> valid_count = 0;
+  std::size_t read_count = 0;
+  for (std::uint64_t offset = 0; offset < reader.file_size(); offset += opts.buffer_size) {
+    reader.read(offset, opts.buffer_size, [&](fst::async_file_reader::completion&& c) {
+      bytes += c.view().size();
+      valid_count += check(c);
+    });
+    read_count++;
+  }
+
+  reader.wait();
+  EXPECT_EQ(bytes, reader.file_size());
+  EXPECT_EQ(valid_count, read_count);
+  reader.close();
+  EXPECT_FALSE(reader.is_open());
+}
+
+INSTANTIATE_TEST_SUITE_P(async_file_reader, async_file_reader_test, ::testing::Values(true, false));
+} // namespace
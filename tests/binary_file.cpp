@@ -108,4 +108,108 @@ TEST(binary_file, custom_vector) {
   EXPECT_FALSE(file_loader.load(std::filesystem::temp_directory_path() / "data_file.data"));
   check_loader(file_loader);
 }
+
+TEST(binary_file, slot_map) {
+  using map_type = fst::slot_map<abc>;
+  using key_type = map_type::key_type;
+
+  map_type map;
+  std::vector<key_type> keys;
+  for (int i = 0; i < 32; i++) {
+    keys.push_back(map.insert(abc{ i, i * 2, i * 3 }));
+  }
+
+  map.erase(keys[3]);
+  map.erase(keys[7]);
+
+  fst::binary_file::writer w;
+  EXPECT_EQ(fst::binary_file::add_slot_map(w, "entities", map), fst::binary_file::write_error::invalid_name);
+  EXPECT_FALSE(fst::binary_file::add_slot_map(w, "ents", map));
+  map_type empty_map;
+  EXPECT_FALSE(fst::binary_file::add_slot_map(w, "empty", empty_map));
+
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "slot_map_file.data";
+  EXPECT_FALSE(w.write_to_file(path));
+
+  fst::binary_file::loader l;
+  EXPECT_FALSE(l.load(path));
+
+  map_type loaded;
+  EXPECT_FALSE(fst::binary_file::load_slot_map(l, "ents", loaded));
+  EXPECT_EQ(loaded.size(), 30);
+  EXPECT_EQ(loaded.slot_count(), map.slot_count());
+
+  for (int i = 0; i < 32; i++) {
+    if (i == 3 || i == 7) {
+      EXPECT_TRUE(loaded.find(keys[i]) == loaded.end());
+    }
+    else {
+      EXPECT_EQ(loaded.at(keys[i]).c, i * 3);
+    }
+  }
+
+  // The free list is restored.
+  key_type k0 = map.insert(abc{ 100, 0, 0 });
+  key_type k1 = loaded.insert(abc{ 100, 0, 0 });
+  EXPECT_EQ(k0.get_index(), k1.get_index());
+  EXPECT_EQ(k0.get_generation(), k1.get_generation());
+
+  map_type empty;
+  EXPECT_FALSE(fst::binary_file::load_slot_map(l, "empty", empty));
+  EXPECT_TRUE(empty.empty());
+
+  EXPECT_EQ(fst::binary_file::load_slot_map(l, "none", empty), fst::binary_file::loader::error_type::missing_chunk);
+}
+
+TEST(binary_file, slot_map_invalid_data) {
+  using map_type = fst::slot_map<abc>;
+  using index_type = map_type::key_type::index_type;
+
+  map_type map;
+  for (int i = 0; i < 8; i++) {
+    map.insert(abc{ i, i * 2, i * 3 });
+  }
+
+  fst::binary_file::writer w;
+  EXPECT_FALSE(fst::binary_file::add_slot_map(w, "ents", map));
+  const fst::byte_vector data = w.write_to_buffer();
+
+  fst::binary_file::loader l;
+  EXPECT_FALSE(l.load(data));
+
+  std::vector<index_type> reverse_map(map.size());
+  std::memcpy(reverse_map.data(), l.get_data("ents.r").data(), reverse_map.size() * sizeof(index_type));
+
+  // The same chunks with a reverse map that doesn't match the slots.
+  const auto load_with_reverse_map = [&](const std::vector<index_type>& r, map_type& loaded) {
+    fst::binary_file::writer bad_w;
+    EXPECT_FALSE(bad_w.add_chunk_ref("bad.h", l.get_data("ents.h")));
+    EXPECT_FALSE(bad_w.add_chunk_ref("bad.s", l.get_data("ents.s")));
+    EXPECT_FALSE(bad_w.add_chunk_ref(
+        "bad.r", fst::byte_view((const std::uint8_t*)r.data(), r.size() * sizeof(index_type))));
+    EXPECT_FALSE(bad_w.add_chunk_ref("bad.v", l.get_data("ents.v")));
+    const fst::byte_vector bad_data = bad_w.write_to_buffer();
+
+    fst::binary_file::loader bad_l;
+    EXPECT_FALSE(bad_l.load(bad_data));
+    return fst::binary_file::load_slot_map(bad_l, "bad", loaded);
+  };
+
+  map_type loaded;
+  EXPECT_FALSE(load_with_reverse_map(reverse_map, loaded));
+  EXPECT_EQ(loaded.size(), 8);
+
+  std::vector<index_type> same_slot = reverse_map;
+  same_slot[1] = same_slot[0];
+
+  map_type other;
+  other.insert(abc{ 1, 2, 3 });
+  EXPECT_EQ(load_with_reverse_map(same_slot, other), fst::binary_file::loader::error_type::invalid_data);
+  EXPECT_EQ(other.size(), 1);
+
+  std::vector<index_type> out_of_range = reverse_map;
+  out_of_range[1] = 1000;
+  EXPECT_EQ(load_with_reverse_map(out_of_range, other), fst::binary_file::loader::error_type::invalid_data);
+  EXPECT_EQ(other.size(), 1);
+}
 } // namespace
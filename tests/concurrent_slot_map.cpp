@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include "fst/concurrent_slot_map.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+struct entity {
+  int id;
+  float x, y, z;
+};
+
+TEST(concurrent_slot_map, constructor) {
+  using map_type = fst::concurrent_slot_map<int>;
+  map_type map(4);
+  EXPECT_EQ(map.capacity(), 4);
+  EXPECT_TRUE(map.empty());
+
+  auto k1 = map.insert(1);
+  auto k2 = map.emplace(2);
+  ASSERT_TRUE(k1 && k2);
+  EXPECT_EQ(map.size(), 2);
+  EXPECT_EQ(map.find(*k1), 1);
+  EXPECT_EQ(map.find(*k2), 2);
+
+  EXPECT_TRUE(map.erase(*k1));
+  EXPECT_FALSE(map.erase(*k1));
+  EXPECT_FALSE(map.contains(*k1));
+  EXPECT_FALSE(map.find(*k1));
+  EXPECT_EQ(map.find(*k2), 2);
+  EXPECT_EQ(map.size(), 1);
+}
+
+TEST(concurrent_slot_map, stale_key) {
+  fst::concurrent_slot_map<entity> map(1);
+
+  auto k1 = map.insert({ 1, 1.0f, 2.0f, 3.0f });
+  ASSERT_TRUE(k1);
+  EXPECT_FALSE(map.insert({ 2, 0.0f, 0.0f, 0.0f }));
+
+  EXPECT_TRUE(map.erase(*k1));
+  auto k2 = map.insert({ 3, 4.0f, 5.0f, 6.0f });
+  ASSERT_TRUE(k2);
+  EXPECT_EQ(k1->get_index(), k2->get_index());
+  EXPECT_NE(k1->get_generation(), k2->get_generation());
+
+  EXPECT_FALSE(map.find(*k1));
+  std::optional<entity> e = map.find(*k2);
+  ASSERT_TRUE(e);
+  EXPECT_EQ(e->id, 3);
+  EXPECT_EQ(e->z, 6.0f);
+}
+
+TEST(concurrent_slot_map, reuse_dense_positions) {
+  fst::concurrent_slot_map<int> map(4);
+
+  // Erased values give their dense position back, inserting never fails after churn.
+  for (int i = 0; i < 64; i++) {
+    auto k = map.insert(i);
+    ASSERT_TRUE(k);
+    EXPECT_TRUE(map.erase(*k));
+  }
+
+  EXPECT_EQ(map.dense_size(), 1);
+
+  std::optional<fst::concurrent_slot_map<int>::key_type> keys[4];
+  for (int i = 0; i < 4; i++) {
+    keys[i] = map.insert(i);
+    ASSERT_TRUE(keys[i]);
+  }
+
+  EXPECT_FALSE(map.insert(4));
+  EXPECT_EQ(map.dense_size(), 4);
+
+  EXPECT_TRUE(map.erase(*keys[1]));
+  EXPECT_TRUE(map.erase(*keys[2]));
+  keys[1] = map.insert(10);
+  ASSERT_TRUE(keys[1]);
+  EXPECT_EQ(map.dense_size(), 4);
+
+  int count = 0;
+  int sum = 0;
+  map.for_each([&](const auto& key, int value) {
+    EXPECT_EQ(map.find(key), value);
+    sum += value;
+    count++;
+  });
+
+  EXPECT_EQ(count, 3);
+  EXPECT_EQ(sum, 0 + 10 + 3);
+}
+
+TEST(concurrent_slot_map, multi_threads) {
+  constexpr std::size_t writer_count = 4;
+  constexpr std::size_t reader_count = 4;
+  constexpr std::size_t live_count = 16;
+  constexpr std::size_t capacity = writer_count * live_count;
+  constexpr int iterations = 5000;
+
+  fst::concurrent_slot_map<entity> map(capacity);
+  std::atomic<bool> done = false;
+
+  // Keys published by the writers for the readers.
+  std::vector<std::atomic<std::uint64_t>> published(writer_count);
+  for (auto& p : published) {
+    p.store(0);
+  }
+
+  std::vector<std::thread> readers;
+  for (std::size_t r = 0; r < reader_count; r++) {
+    readers.emplace_back([&, r]() {
+      while (!done.load()) {
+        const std::uint64_t p = published[r % writer_count].load();
+        if (!p) {
+          continue;
+        }
+
+        fst::concurrent_slot_map<entity>::key_type key;
+        key.set_index((std::uint32_t)p);
+        key.set_generation((std::uint32_t)(p >> 32));
+
+        // A value is either gone or consistent, never torn.
+        if (std::optional<entity> e = map.find(key)) {
+          EXPECT_EQ((float)e->id, e->x);
+          EXPECT_EQ((float)e->id, e->z);
+        }
+      }
+    });
+  }
+
+  readers.emplace_back([&]() {
+    while (!done.load()) {
+      std::size_t count = 0;
+      map.for_each([&](const auto&, const entity& e) {
+        EXPECT_EQ((float)e.id, e.y);
+        count++;
+      });
+
+      EXPECT_LE(count, capacity);
+    }
+  });
+
+  // Each writer keeps up to live_count values, the map is full most of the time
+  // and the dense positions are reused over and over.
+  std::atomic<int> inserted = 0;
+  std::vector<std::thread> writers;
+  for (std::size_t w = 0; w < writer_count; w++) {
+    writers.emplace_back([&, w]() {
+      std::vector<fst::concurrent_slot_map<entity>::key_type> keys;
+
+      for (int i = 0; i < iterations; i++) {
+        if (keys.size() == live_count) {
+          EXPECT_TRUE(map.erase(keys.front()));
+          keys.erase(keys.begin());
+        }
+
+        const int id = (int)w * iterations + i;
+        auto key = map.insert({ id, (float)id, (float)id, (float)id });
+        ASSERT_TRUE(key);
+        inserted++;
+        keys.push_back(*key);
+
+        published[w].store((std::uint64_t)key->get_generation() << 32 | key->get_index());
+        EXPECT_EQ(map.find(*key)->id, id);
+      }
+
+      for (const auto& key : keys) {
+        EXPECT_TRUE(map.erase(key));
+      }
+    });
+  }
+
+  for (std::thread& t : writers) {
+    t.join();
+  }
+
+  done = true;
+  for (std::thread& t : readers) {
+    t.join();
+  }
+
+  EXPECT_EQ(inserted, iterations * (int)writer_count);
+  EXPECT_LE(map.dense_size(), capacity);
+  EXPECT_TRUE(map.empty());
+}
+} // namespace
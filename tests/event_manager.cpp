@@ -0,0 +1,284 @@
+#include <gtest/gtest.h>
+
+#include "fst/event_manager.h"
+#include <mutex>
+#include <vector>
+
+namespace {
+using namespace std::chrono_literals;
+
+TEST(event_manager, delayed_event) {
+  fst::event_manager em;
+  em.init(1);
+
+  std::atomic<int> count = 0;
+  const auto start = fst::event_manager::clock_type::now();
+  std::atomic<fst::event_manager::clock_type::time_point::rep> called_at = 0;
+
+  fst::event_manager::event_id id = em.add_delayed_event(
+      [&]() {
+        called_at = (fst::event_manager::clock_type::now() - start).count();
+        count++;
+      },
+      20ms);
+
+  EXPECT_TRUE(em.is_connected(id));
+  std::this_thread::sleep_for(100ms);
+
+  EXPECT_EQ(count, 1);
+  EXPECT_GE(called_at, std::chrono::duration_cast<fst::event_manager::duration>(20ms).count());
+  EXPECT_FALSE(em.is_connected(id));
+  EXPECT_FALSE(em.remove_event(id));
+}
+
+TEST(event_manager, order) {
+  fst::event_manager em;
+  em.init(1);
+
+  std::mutex mutex;
+  std::vector<int> order;
+  auto push = [&](int v) {
+    std::lock_guard<std::mutex> lock(mutex);
+    order.push_back(v);
+  };
+
+  em.add_delayed_event([&]() { push(3); }, 90ms);
+  em.add_delayed_event([&]() { push(1); }, 10ms);
+  em.add_delayed_event([&]() { push(2); }, 70ms);
+  std::this_thread::sleep_for(200ms);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ(order, std::vector<int>({ 1, 2, 3 }));
+}
+
+TEST(event_manager, periodic_event) {
+  fst::event_manager em;
+
+  // Added before init.
+  std::atomic<int> count = 0;
+  fst::event_manager::disconnector d(em, em.add_periodic_event([&]() { count++; }, 5ms));
+  em.init(1);
+
+  std::this_thread::sleep_for(100ms);
+  EXPECT_TRUE(d.is_connected());
+  d.disconnect();
+  EXPECT_FALSE(d.is_connected());
+
+  const int last_count = count;
+  EXPECT_GT(last_count, 5);
+  EXPECT_LT(last_count, 40);
+
+  std::this_thread::sleep_for(30ms);
+  EXPECT_EQ(count, last_count);
+}
+
+TEST(event_manager, recurrent_ticks) {
+  fst::event_manager em;
+  em.init(2);
+  EXPECT_EQ(em.get_delta_time(), 2);
+
+  std::atomic<int> count = 0;
+  std::atomic<int> once = 0;
+  fst::event_manager::event_id id = em.add_recurrent_event([&]() { count++; }, 5);
+  em.add_event([&]() { once++; });
+
+  std::this_thread::sleep_for(100ms);
+  EXPECT_TRUE(em.remove_event(id));
+  EXPECT_GT(count, 3);
+  EXPECT_EQ(once, 1);
+}
+
+TEST(event_manager, far_deadline) {
+  fst::event_manager em;
+  em.init(1);
+
+  std::atomic<int> count = 0;
+
+  // Beyond the range of the wheel at this resolution.
+  fst::event_manager::event_id far_id = em.add_delayed_event([&]() { count++; }, 10h);
+  fst::event_manager::event_id mid_id = em.add_delayed_event([&]() { count++; }, 2min);
+  em.add_delayed_event([&]() { count += 10; }, 5ms);
+
+  std::this_thread::sleep_for(50ms);
+  EXPECT_EQ(count, 10);
+  EXPECT_TRUE(em.is_connected(far_id));
+  EXPECT_TRUE(em.remove_event(far_id));
+  EXPECT_TRUE(em.remove_event(mid_id));
+  EXPECT_FALSE(em.is_connected(far_id));
+}
+
+TEST(event_manager, many_events) {
+  constexpr std::size_t event_count = 20000;
+  fst::event_manager em;
+  em.init(1);
+  em.reserve(event_count);
+
+  std::atomic<std::size_t> count = 0;
+  std::vector<fst::event_manager::disconnector> ds;
+  for (std::size_t i = 0; i < event_count; i++) {
+    ds.emplace_back(em, em.add_delayed_event([&count]() { count++; }, std::chrono::milliseconds(1 + i % 17)));
+  }
+
+  // Far periodic events are kept until disconnected.
+  for (std::size_t i = 0; i < event_count; i++) {
+    ds.emplace_back(em, em.add_periodic_event([&count]() { count++; }, 1h));
+  }
+
+  std::this_thread::sleep_for(100ms);
+  EXPECT_EQ(count, event_count);
+  EXPECT_EQ(em.size(), event_count);
+
+  for (std::size_t i = 0; i < event_count; i++) {
+    EXPECT_FALSE(ds[i].is_connected());
+    EXPECT_TRUE(ds[event_count + i].is_connected());
+  }
+
+  ds.clear();
+  EXPECT_EQ(em.size(), 0);
+}
+
+TEST(event_manager, callback_modifies_events) {
+  fst::event_manager em;
+  em.init(1);
+
+  std::atomic<int> count = 0;
+  std::atomic<bool> removed = false;
+  fst::event_manager::event_id id = fst::event_manager::invalid_id;
+  std::atomic<fst::event_manager::event_id> self_id = fst::event_manager::invalid_id;
+
+  // The callbacks can use the event_manager, nothing is locked while they run.
+  id = em.add_delayed_event(
+      [&]() {
+        em.add_delayed_event([&]() { count++; }, 1ms);
+        self_id = em.add_periodic_event(
+            [&]() {
+              if (!removed.exchange(true)) {
+                EXPECT_TRUE(em.remove_event(self_id));
+              }
+            },
+            2ms);
+      },
+      1ms);
+
+  std::this_thread::sleep_for(50ms);
+  EXPECT_EQ(count, 1);
+  EXPECT_TRUE(removed);
+  EXPECT_FALSE(em.is_connected(id));
+  EXPECT_FALSE(em.is_connected(self_id));
+}
+
+TEST(event_manager, slow_callback) {
+  fst::event_manager em;
+  em.init(1);
+
+  std::atomic<bool> is_running = false;
+  std::atomic<bool> is_done = false;
+  fst::event_manager::event_id id = em.add_delayed_event(
+      [&]() {
+        is_running = true;
+        std::this_thread::sleep_for(50ms);
+        is_done = true;
+      },
+      1ms);
+
+  while (!is_running) {
+    std::this_thread::yield();
+  }
+
+  // Adding doesn't wait for the callback.
+  const auto start = fst::event_manager::clock_type::now();
+  fst::event_manager::event_id other_id = em.add_delayed_event([]() {}, 1h);
+  EXPECT_LT(fst::event_manager::clock_type::now() - start, 25ms);
+  EXPECT_FALSE(is_done);
+
+  // Removing a running event waits for its callback to return.
+  EXPECT_TRUE(em.remove_event(other_id));
+  em.remove_event(id);
+  EXPECT_TRUE(is_done);
+}
+
+TEST(event_manager, workers) {
+  fst::event_manager em;
+  em.init(1, 3);
+  EXPECT_EQ(em.get_worker_count(), 3);
+
+  std::mutex mutex;
+  std::vector<std::thread::id> threads[2];
+  std::atomic<int> count = 0;
+
+  std::vector<fst::event_manager::disconnector> ds;
+  for (std::size_t i = 0; i < 2; i++) {
+    for (std::size_t k = 0; k < 4; k++) {
+      fst::event_manager::event_id id = em.add_periodic_event(
+          [&, i]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads[i].push_back(std::this_thread::get_id());
+          },
+          2ms);
+
+      EXPECT_TRUE(em.set_event_affinity(id, i));
+      ds.emplace_back(em, id);
+    }
+  }
+
+  for (std::size_t i = 0; i < 16; i++) {
+    ds.emplace_back(em, em.add_periodic_event([&]() { count++; }, 1ms));
+  }
+
+  std::this_thread::sleep_for(60ms);
+  ds.clear();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  ASSERT_FALSE(threads[0].empty());
+  ASSERT_FALSE(threads[1].empty());
+  EXPECT_GT(count, 16);
+
+  // Events with the same affinity always run on the same worker.
+  EXPECT_NE(threads[0][0], threads[1][0]);
+  EXPECT_NE(threads[0][0], std::this_thread::get_id());
+  for (std::size_t i = 0; i < 2; i++) {
+    for (std::thread::id tid : threads[i]) {
+      EXPECT_EQ(tid, threads[i][0]);
+    }
+  }
+}
+
+TEST(event_manager, workers_remove_each_other) {
+  fst::event_manager em;
+  em.init(1, 2);
+
+  std::atomic<fst::event_manager::event_id> ids[2] = { fst::event_manager::invalid_id, fst::event_manager::invalid_id };
+  std::atomic<int> calls[2] = { 0, 0 };
+  std::atomic<bool> removed[2] = { false, false };
+  std::atomic<int> arrived = 0;
+
+  for (std::size_t i = 0; i < 2; i++) {
+    ids[i] = em.add_periodic_event(
+        [&, i]() {
+          calls[i]++;
+          arrived++;
+
+          // Both callbacks run at the same time, each one removes the other's event.
+          while (arrived < 2) {
+            std::this_thread::yield();
+          }
+
+          removed[i] = em.remove_event(ids[1 - i]);
+        },
+        2ms, 20ms);
+
+    EXPECT_TRUE(em.set_event_affinity(ids[i], i));
+  }
+
+  while (em.size()) {
+    std::this_thread::sleep_for(1ms);
+  }
+
+  std::this_thread::sleep_for(10ms);
+  for (std::size_t i = 0; i < 2; i++) {
+    EXPECT_TRUE(removed[i]);
+    EXPECT_EQ(calls[i], 1);
+    EXPECT_FALSE(em.is_connected(ids[i]));
+  }
+}
+} // namespace
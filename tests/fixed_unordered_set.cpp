@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "fst/fixed_unordered_set.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+TEST(fixed_unordered_set, lock_free) {
+  fst::lock_free_fixed_unordered_set<int, 130> set;
+  EXPECT_TRUE(set.empty());
+
+  set.insert(129);
+  set.insert(3);
+  set.insert(64);
+  set.insert(3);
+  EXPECT_EQ(set.size(), 3);
+  EXPECT_TRUE(set.contains(3));
+  EXPECT_TRUE(set.contains(64));
+  EXPECT_FALSE(set.contains(63));
+
+  set.erase(64);
+  EXPECT_FALSE(set.contains(64));
+
+  fst::lock_free_fixed_unordered_set<int, 130>::array_type content = set.get_content();
+  EXPECT_EQ(content.size(), 2);
+  EXPECT_EQ(content[0], 3);
+  EXPECT_EQ(content[1], 129);
+  EXPECT_EQ(set.size(), 2);
+
+  content = set.get_content_and_clear();
+  EXPECT_EQ(content.size(), 2);
+  EXPECT_TRUE(set.empty());
+}
+
+TEST(fixed_unordered_set, lock_free_threads) {
+  constexpr std::size_t size = 256;
+  constexpr std::size_t thread_count = 4;
+  constexpr std::size_t rounds = 200;
+
+  fst::lock_free_fixed_unordered_set<std::size_t, size> set;
+  std::vector<std::size_t> received(size, 0);
+  std::atomic<std::size_t> done_count = 0;
+  std::vector<std::thread> threads;
+
+  // Each thread marks its own values as dirty once per round, every insert must be received exactly once.
+  for (std::size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t]() {
+      for (std::size_t r = 0; r < rounds; r++) {
+        for (std::size_t i = t; i < size; i += thread_count) {
+          while (set.contains(i)) {
+            std::this_thread::yield();
+          }
+
+          set.insert(i);
+        }
+      }
+
+      done_count++;
+    });
+  }
+
+  while (done_count != thread_count || !set.empty()) {
+    for (std::size_t v : set.get_content_and_clear()) {
+      received[v]++;
+    }
+  }
+
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  for (std::size_t count : received) {
+    EXPECT_EQ(count, rounds);
+  }
+}
+} // namespace
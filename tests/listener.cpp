@@ -1,7 +1,11 @@
 #include <gtest/gtest.h>
 #include "fst/listener.h"
 #include "fst/small_vector.h"
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 class listener {
 public:
@@ -41,12 +45,12 @@ TEST(listener, bb) {
   listeners.remove(&c);
   EXPECT_EQ(listeners.size(), 2);
 
-  EXPECT_EQ(listeners.get().capacity(), 2);
+  EXPECT_EQ(listeners.get()->capacity(), 2);
 
   listeners.add(&c);
   EXPECT_EQ(listeners.size(), 3);
 
-//  EXPECT_TRUE(listeners.get().capacity() > 2);
+//  EXPECT_TRUE(listeners.get()->capacity() > 2);
 
   listeners.remove(&b);
   EXPECT_EQ(listeners.size(), 2);
@@ -58,7 +62,7 @@ TEST(listener, bb) {
   EXPECT_EQ(listeners.size(), 0);
 
   //    listeners.reset();
-  //    EXPECT_EQ(listeners.get().capacity(), 2);
+  //    EXPECT_EQ(listeners.get()->capacity(), 2);
 }
 
 TEST(listener, vector) {
@@ -83,12 +87,12 @@ TEST(listener, vector) {
   listeners.remove(&c);
   EXPECT_EQ(listeners.size(), 2);
 
-//  EXPECT_EQ(listeners.get().capacity(), 2);
+//  EXPECT_EQ(listeners.get()->capacity(), 2);
 
   listeners.add(&c);
   EXPECT_EQ(listeners.size(), 3);
 
-//  EXPECT_EQ(listeners.get().capacity(), 4);
+//  EXPECT_EQ(listeners.get()->capacity(), 4);
 
   listeners.remove(&b);
   EXPECT_EQ(listeners.size(), 2);
@@ -100,5 +104,270 @@ TEST(listener, vector) {
   EXPECT_EQ(listeners.size(), 0);
 
   listeners.reset();
-//  EXPECT_EQ(listeners.get().capacity(), 0);
+//  EXPECT_EQ(listeners.get()->capacity(), 0);
+}
+
+class removing_listener : public listener {
+public:
+  inline removing_listener(fst::mt::listener_manager<listener>& listeners, listener* to_remove)
+      : _listeners(listeners)
+      , _to_remove(to_remove) {}
+
+  virtual ~removing_listener() = default;
+
+  virtual void on_action(std::size_t& count) {
+    count++;
+    _listeners.remove(_to_remove);
+    _listeners.remove(this);
+  }
+
+private:
+  fst::mt::listener_manager<listener>& _listeners;
+  listener* _to_remove;
+};
+
+TEST(listener, remove_from_notify) {
+  fst::mt::listener_manager<listener> listeners;
+  listener_imp a;
+  removing_listener b(listeners, &a);
+
+  listeners.add(&b);
+  listeners.add(&a);
+  EXPECT_EQ(listeners.size(), 2);
+
+  // The notification in progress keeps its snapshot.
+  std::size_t count = 0;
+  listeners.notify<&listener::on_action>(count);
+  EXPECT_EQ(count, 2);
+  EXPECT_TRUE(listeners.empty());
+
+  count = 0;
+  listeners.notify<&listener::on_action>(count);
+  EXPECT_EQ(count, 0);
+}
+
+TEST(listener, snapshot) {
+  fst::mt::listener_manager<listener> listeners;
+  listener_imp a;
+  listener_imp b;
+  listeners.add(&a);
+
+  {
+    const auto s = listeners.get();
+    listeners.add(&b);
+    EXPECT_EQ(s.size(), 1);
+    EXPECT_EQ(listeners.size(), 2);
+  }
+
+  listeners.clear();
+  EXPECT_TRUE(listeners.empty());
+}
+
+TEST(listener, concurrent_notify) {
+  constexpr std::size_t listener_count = 16;
+  constexpr std::size_t thread_count = 4;
+
+  fst::mt::listener_manager<listener> listeners;
+  std::vector<std::unique_ptr<listener_imp>> imps;
+  std::atomic<bool> done = false;
+
+  listener_imp always;
+  listeners.add(&always);
+
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&]() {
+      while (!done) {
+        std::size_t count = 0;
+        listeners.notify<&listener::on_action>(count);
+        EXPECT_GE(count, 1);
+      }
+    });
+  }
+
+  // Removed listeners are destroyed right away, remove() must wait for the notifications using them.
+  for (std::size_t r = 0; r < 4; r++) {
+    for (std::size_t i = 0; i < listener_count; i++) {
+      imps.push_back(std::make_unique<listener_imp>());
+      listeners.add(imps.back().get());
+    }
+
+    EXPECT_EQ(listeners.size(), listener_count + 1);
+
+    while (!imps.empty()) {
+      listeners.remove(imps.back().get());
+      imps.pop_back();
+    }
+  }
+
+  done = true;
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(listeners.size(), 1);
+}
+
+TEST(listener, registry) {
+  fst::listener_manager<listener> listeners;
+  std::vector<listener_imp> imps(1000);
+
+  for (listener_imp& l : imps) {
+    EXPECT_TRUE(listeners.add(&l));
+  }
+
+  EXPECT_FALSE(listeners.add(&imps[10]));
+  EXPECT_EQ(listeners.size(), imps.size());
+
+  for (std::size_t i = 0; i < imps.size(); i += 2) {
+    EXPECT_TRUE(listeners.remove(&imps[i]));
+  }
+
+  EXPECT_FALSE(listeners.remove(&imps[0]));
+  EXPECT_EQ(listeners.size(), imps.size() / 2);
+  EXPECT_EQ(listeners.get().size(), imps.size() / 2);
+
+  for (std::size_t i = 0; i < imps.size(); i++) {
+    EXPECT_EQ(listeners.contains(&imps[i]), i % 2 == 1);
+  }
+
+  std::size_t count = 0;
+  listeners.notify<&listener::on_action>(count);
+  EXPECT_EQ(count, imps.size() / 2);
+}
+
+TEST(listener, registry_stable_order) {
+  fst::listener_manager<listener, std::vector, true> listeners;
+  std::vector<listener_imp> imps(10);
+
+  for (listener_imp& l : imps) {
+    listeners.add(&l);
+  }
+
+  listeners.remove(&imps[2]);
+  listeners.remove(&imps[5]);
+  EXPECT_EQ(listeners.size(), 8);
+
+  std::vector<listener*> expected;
+  for (std::size_t i = 0; i < imps.size(); i++) {
+    if (i != 2 && i != 5) {
+      expected.push_back(&imps[i]);
+    }
+  }
+
+  EXPECT_EQ(std::vector<listener*>(listeners.begin(), listeners.end()), expected);
+
+  // Compacted once half of the array is holes.
+  for (std::size_t i = 6; i < imps.size(); i++) {
+    listeners.remove(&imps[i]);
+  }
+
+  EXPECT_EQ(listeners.get().size(), 4);
+  EXPECT_EQ(std::vector<listener*>(listeners.begin(), listeners.end()),
+      std::vector<listener*>({ &imps[0], &imps[1], &imps[3], &imps[4] }));
+}
+
+TEST(listener, registry_mutate_during_notify) {
+  fst::listener_manager<listener> listeners;
+  listener_imp a;
+  listener_imp b;
+  listener_imp c;
+  listeners.add(&a);
+  listeners.add(&b);
+
+  std::size_t visited = 0;
+  listeners.for_each([&](listener* l) {
+    visited++;
+    if (l == &a) {
+      listeners.remove(&b);
+      listeners.remove(&a);
+      listeners.add(&c);
+    }
+  });
+
+  // b was removed before being visited, c is added for the next iteration.
+  EXPECT_EQ(visited, 1);
+  EXPECT_EQ(listeners.size(), 1);
+  EXPECT_EQ(listeners.get().size(), 1);
+  EXPECT_TRUE(listeners.contains(&c));
+
+  std::size_t count = 0;
+  listeners.notify<&listener::on_action>(count);
+  EXPECT_EQ(count, 1);
+}
+
+TEST(listener, concurrent_writers) {
+  constexpr std::size_t reader_count = 3;
+  constexpr std::size_t writer_count = 2;
+  constexpr std::size_t iterations = 5000;
+
+  fst::mt::listener_manager<listener> listeners;
+  std::vector<listener_imp> imps(writer_count);
+  std::atomic<bool> done = false;
+
+  listener_imp always;
+  listeners.add(&always);
+
+  std::vector<std::thread> readers;
+  for (std::size_t t = 0; t < reader_count; t++) {
+    readers.emplace_back([&]() {
+      while (!done) {
+        std::size_t count = 0;
+        listeners.notify<&listener::on_action>(count);
+        EXPECT_GE(count, 1);
+      }
+    });
+  }
+
+  // Back to back publications from several threads, every retired snapshot must outlive its readers.
+  std::vector<std::thread> writers;
+  for (std::size_t t = 0; t < writer_count; t++) {
+    writers.emplace_back([&, t]() {
+      for (std::size_t i = 0; i < iterations; i++) {
+        listeners.add(&imps[t]);
+        listeners.remove(&imps[t]);
+      }
+    });
+  }
+
+  for (std::thread& t : writers) {
+    t.join();
+  }
+
+  done = true;
+  for (std::thread& t : readers) {
+    t.join();
+  }
+
+  EXPECT_EQ(listeners.size(), 1);
+}
+
+namespace {
+void nested_get(fst::mt::listener_manager<listener>& listeners, listener* l, std::size_t depth) {
+  const auto s = listeners.get();
+  if (depth) {
+    nested_get(listeners, l, depth - 1);
+    return;
+  }
+
+  // Deeper than the reader stack, remove() must still see this thread as a reader and not wait.
+  listeners.remove(l);
+  EXPECT_EQ(s.size(), 1);
+}
+} // namespace
+
+TEST(listener, nested_snapshots) {
+  fst::mt::listener_manager<listener> listeners;
+  listener_imp a;
+  listeners.add(&a);
+
+  nested_get(listeners, &a, 2 * fst::mt::detail::listener_reader_stack::maximum_depth);
+  EXPECT_TRUE(listeners.empty());
+  EXPECT_EQ(fst::mt::detail::listener_readers.size, 0);
+  EXPECT_EQ(fst::mt::detail::listener_readers.overflow_count, 0);
+
+  // Every snapshot is released, this one can't be left waiting.
+  listeners.add(&a);
+  listeners.remove(&a);
+  EXPECT_TRUE(listeners.empty());
 }
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <cstring>
 #include <string_view>
 #include <filesystem>
 #include "fst/mapped_file.h"
@@ -13,4 +14,113 @@ TEST(mapped_file, open) {
   EXPECT_EQ(fb.open(FST_TEST_RESOURCES_DIRECTORY "/test.txt"), true);
   EXPECT_EQ(fb.str(), "Test");
 }
+
+TEST(mapped_file, writable) {
+  const std::filesystem::path filepath = std::filesystem::temp_directory_path() / "fst_writable_mapped_file.bin";
+
+  {
+    fst::writable_mapped_file file;
+    EXPECT_TRUE(file.create(filepath, 0));
+    EXPECT_TRUE(file.is_open());
+    EXPECT_TRUE(file.empty());
+    EXPECT_EQ(file.data(), nullptr);
+
+    EXPECT_TRUE(file.resize(4));
+    std::memcpy(file.data(), "Test", 4);
+
+    // Grow past a page, the first bytes must be kept.
+    EXPECT_TRUE(file.resize(3 * 4096 + 10));
+    EXPECT_EQ(file.size(), 3 * 4096 + 10);
+    EXPECT_EQ(std::string_view((const char*)file.data(), 4), "Test");
+    EXPECT_EQ(file[5000], 0);
+
+    file[3 * 4096 + 9] = 'A';
+    EXPECT_TRUE(file.flush(3 * 4096 + 9, 1));
+    EXPECT_TRUE(file.flush());
+  }
+
+  EXPECT_EQ(std::filesystem::file_size(filepath), 3 * 4096 + 10);
+
+  {
+    fst::writable_mapped_file file;
+    EXPECT_TRUE(file.open(filepath));
+    EXPECT_EQ(file[3 * 4096 + 9], 'A');
+
+    EXPECT_TRUE(file.resize(4));
+  }
+
+  fst::mapped_file fb;
+  EXPECT_TRUE(fb.open(filepath));
+  EXPECT_EQ(fb.str(), "Test");
+  fb.close();
+
+  std::filesystem::remove(filepath);
+}
+
+TEST(mapped_file, windowed) {
+  const std::filesystem::path filepath = std::filesystem::temp_directory_path() / "fst_windowed_mapped_file.bin";
+  constexpr std::size_t count = 100000;
+
+  {
+    fst::writable_mapped_file file;
+    EXPECT_TRUE(file.create(filepath, count * sizeof(std::uint32_t) + 1));
+    for (std::uint32_t i = 0; i < count; i++) {
+      std::memcpy(file.data() + 1 + i * sizeof(std::uint32_t), &i, sizeof(std::uint32_t));
+    }
+  }
+
+  fst::windowed_mapped_file file;
+  EXPECT_TRUE(file.open(filepath, 4096, 2));
+  EXPECT_EQ(file.size(), count * sizeof(std::uint32_t) + 1);
+  EXPECT_EQ(file.window_size() % 4096, 0);
+
+  // Values are not aligned on windows, some of them are split across two windows.
+  fst::windowed_mapped_file::cursor c = file.get_cursor(1);
+  bool all_equal = true;
+  for (std::uint32_t i = 0; i < count; i++) {
+    all_equal = all_equal && c.read<std::uint32_t>() == i;
+  }
+
+  EXPECT_TRUE(all_equal);
+  EXPECT_TRUE(c.eof());
+  EXPECT_EQ(c.read<std::uint32_t>(), 0);
+
+  // Random access, evicting windows behind the cursor.
+  c.seek(1 + 5000 * sizeof(std::uint32_t));
+  std::uint32_t value = 0;
+  EXPECT_EQ(file.read(1 + 90000 * sizeof(std::uint32_t), &value, sizeof(value)), sizeof(value));
+  EXPECT_EQ(value, 90000);
+  EXPECT_EQ(file.read(1 + 10 * sizeof(std::uint32_t), &value, sizeof(value)), sizeof(value));
+  EXPECT_EQ(value, 10);
+  EXPECT_EQ(c.read<std::uint32_t>(), 5000);
+
+  fst::byte_view w = file.window(file.window_size() + 3);
+  EXPECT_EQ(w.size(), file.window_size() - 3);
+  EXPECT_TRUE(file.window(file.size()).empty());
+
+  file.close();
+  std::filesystem::remove(filepath);
+}
+
+TEST(mapped_file, options) {
+  fst::mapped_file_options options;
+  options.access = fst::mapped_file_options::access_pattern::sequential;
+  options.will_need = true;
+  options.populate = true;
+  options.huge_pages = true;
+
+  fst::mapped_file fb;
+  EXPECT_TRUE(fb.open(FST_TEST_RESOURCES_DIRECTORY "/test.txt", options));
+  EXPECT_EQ(fb.str(), "Test");
+
+  EXPECT_TRUE(fb.prefetch(1, 100));
+  EXPECT_FALSE(fb.prefetch(4, 1));
+  EXPECT_TRUE(fb.lock());
+  EXPECT_TRUE(fb.unlock());
+  EXPECT_EQ(fb.str(), "Test");
+
+  options.access = fst::mapped_file_options::access_pattern::random;
+  EXPECT_TRUE(fb.open(FST_TEST_RESOURCES_DIRECTORY "/test.txt", options));
+  EXPECT_EQ(fb.str(), "Test");
+}
 } // namespace
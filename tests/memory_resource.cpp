@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <fst/memory_resource.h>
+#include <map>
+#include <vector>
+
+namespace {
+TEST(memory_resource, pool) {
+  using pool_allocator_type = fst::memory_pool_allocator<fst::crt_allocator, fst::allocator_stats_counter>;
+
+  pool_allocator_type pool(4096);
+  fst::pmr_resource<pool_allocator_type> resource(pool);
+  EXPECT_TRUE(pool.is_shared());
+
+  std::pmr::vector<int> pmr_buffer(&resource);
+  std::vector<int, fst::allocator<int, pool_allocator_type>> fst_buffer((pool));
+
+  for (int i = 0; i < 100; i++) {
+    pmr_buffer.push_back(i);
+    fst_buffer.push_back(i * 2);
+  }
+
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(pmr_buffer[i] * 2, fst_buffer[i]);
+  }
+
+  // Both families of containers share the same pool.
+  EXPECT_EQ(pool.get_stats().size, resource.get_allocator().get_stats().size);
+  EXPECT_GE(pool.size(), 200 * sizeof(int));
+
+  fst::pmr_resource<pool_allocator_type> other_resource;
+  EXPECT_TRUE(resource.is_equal(resource));
+  EXPECT_FALSE(resource.is_equal(other_resource));
+
+  void* data = resource.allocate(16, 64);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(data) % 64, 0);
+}
+
+TEST(memory_resource, crt) {
+  fst::pmr_resource<fst::crt_allocator> resource;
+  fst::pmr_resource<fst::crt_allocator> other_resource;
+  EXPECT_TRUE(resource.is_equal(other_resource));
+
+  std::pmr::map<int, int> map(&resource);
+  for (int i = 0; i < 100; i++) {
+    map[i] = i * 2;
+  }
+
+  EXPECT_EQ(map[50], 100);
+  map.clear();
+}
+
+TEST(memory_resource, memory_resource_allocator) {
+  using allocator_type = fst::allocator<int, fst::memory_resource_allocator>;
+
+  std::pmr::monotonic_buffer_resource resource(1024);
+  EXPECT_FALSE(allocator_type::is_always_equal::value);
+
+  std::vector<int, allocator_type> buffer((fst::memory_resource_allocator(&resource)));
+  std::pmr::vector<int> pmr_buffer(&resource);
+
+  for (int i = 0; i < 100; i++) {
+    buffer.push_back(i);
+    pmr_buffer.push_back(i * 2);
+  }
+
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(buffer[i] * 2, pmr_buffer[i]);
+  }
+
+  EXPECT_EQ(fst::memory_resource_allocator(), fst::memory_resource_allocator(std::pmr::get_default_resource()));
+  EXPECT_NE(fst::memory_resource_allocator(), fst::memory_resource_allocator(&resource));
+}
+} // namespace
@@ -1,52 +1,147 @@
-//#include <gtest/gtest.h>
-//#include <fst/print>
-////#include <thread>
-////#include <chrono>
-//#include "fst/shared_memory.h"
-//#include <fst/span>
-//
-// namespace {
-// TEST(shared_memory, constructor) {
-//  fst::shared_memory sm;
-//  fst::shared_memory sm2;
-//
-//  fst::shared_memory::error_type err = sm.create("fst_shared", 64);
-//  EXPECT_EQ(err, fst::shared_memory::error_type::none);
-//  EXPECT_EQ(sm.size(), 64);
-//
-//  err = sm2.create("fst_shared", 64);
-//  EXPECT_EQ(err, fst::shared_memory::error_type::creation_failed);
-//  //  EXPECT_EQ(sm.size(), 64);
-//
-//  fst::span<std::uint8_t> buffer(sm.data(), sm.size());
-//  for (std::size_t i = 0; i < buffer.size(); i++) {
-//    buffer[i] = i;
-//  }
-//  //  sm.data()[0] = 45;
-//}
-//
-// TEST(shared_memory, double) {
-//  fst::shared_memory sm;
-//
-//  fst::shared_memory::error_type err = sm.create("fst_shared", 64);
-//  EXPECT_EQ(err, fst::shared_memory::error_type::none);
-//  EXPECT_EQ(sm.size(), 64);
-//
-//  fst::span<std::uint8_t> buffer(sm.data(), sm.size());
-//  for (std::size_t i = 0; i < buffer.size(); i++) {
-//    buffer[i] = i;
-//  }
-//
-//  fst::shared_memory sm2;
-//  err = sm2.open("fst_shared", 64);
-//  EXPECT_EQ(err, fst::shared_memory::error_type::none);
-//  EXPECT_EQ(sm2.size(), 64);
-//
-//  sm2.data()[0] = 89;
-//
-//  EXPECT_EQ(sm2.data()[0], sm.data()[0]);
-//  EXPECT_EQ(sm2.data()[1], sm.data()[1]);
-//
-//  //  fst::shared_memory sm3 = sm2;
-//}
-//} // namespace
+#include <gtest/gtest.h>
+#include "fst/shared_memory.h"
+#include <fst/span>
+#include <string>
+
+#if __FST_UNISTD__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if __FST_UNISTD__
+namespace {
+// Segment names are global to the machine, keep them unique to this process.
+std::string get_test_name(const char* name) { return std::string(name) + "_" + std::to_string(::getpid()); }
+
+TEST(shared_memory, constructor) {
+  const std::string name = get_test_name("fst_shared");
+  fst::shared_memory sm;
+  fst::shared_memory sm2;
+
+  fst::shared_memory::error_type err = sm.create(name, 64);
+  EXPECT_EQ(err, fst::shared_memory::error_type::none);
+  EXPECT_EQ(sm.size(), 64);
+  EXPECT_TRUE(sm.is_owner());
+
+  err = sm2.create(name, 64);
+  EXPECT_EQ(err, fst::shared_memory::error_type::creation_failed);
+
+  fst::span<std::uint8_t> buffer(sm.data(), sm.size());
+  for (std::size_t i = 0; i < buffer.size(); i++) {
+    buffer[i] = (std::uint8_t)i;
+  }
+}
+
+TEST(shared_memory, double) {
+  const std::string name = get_test_name("fst_shared");
+  fst::shared_memory sm;
+
+  fst::shared_memory::error_type err = sm.create(name, 64);
+  EXPECT_EQ(err, fst::shared_memory::error_type::none);
+  EXPECT_EQ(sm.size(), 64);
+
+  fst::span<std::uint8_t> buffer(sm.data(), sm.size());
+  for (std::size_t i = 0; i < buffer.size(); i++) {
+    buffer[i] = (std::uint8_t)i;
+  }
+
+  fst::shared_memory sm2;
+  err = sm2.open(name);
+  EXPECT_EQ(err, fst::shared_memory::error_type::none);
+  EXPECT_EQ(sm2.size(), 64);
+  EXPECT_FALSE(sm2.is_owner());
+
+  sm2.data()[0] = 89;
+
+  EXPECT_EQ(sm2.data()[0], sm.data()[0]);
+  EXPECT_EQ(sm2.data()[1], sm.data()[1]);
+
+  EXPECT_EQ(sm2.open(name, 128), fst::shared_memory::error_type::opening_failed);
+}
+
+TEST(shared_memory, unlink) {
+  const std::string name = get_test_name("fst_shared_unlink");
+  fst::shared_memory sm;
+  EXPECT_EQ(sm.create(name, 64), fst::shared_memory::error_type::none);
+
+  // Closing a segment that was only opened keeps the name.
+  {
+    fst::shared_memory sm2;
+    EXPECT_EQ(sm2.open(name), fst::shared_memory::error_type::none);
+  }
+
+  fst::shared_memory sm2;
+  EXPECT_EQ(sm2.open(name), fst::shared_memory::error_type::none);
+  sm2.data()[3] = 12;
+
+  // The memory outlives the name as long as it's mapped.
+  sm.close();
+  EXPECT_EQ(sm2.data()[3], 12);
+
+  fst::shared_memory sm3;
+  EXPECT_EQ(sm3.open(name), fst::shared_memory::error_type::opening_failed);
+
+  EXPECT_EQ(sm.create(name, 32), fst::shared_memory::error_type::none);
+  fst::shared_memory moved = std::move(sm);
+  EXPECT_FALSE(sm.is_valid());
+  EXPECT_TRUE(moved.is_owner());
+  EXPECT_TRUE(fst::shared_memory::unlink(name));
+  EXPECT_EQ(sm3.open(name), fst::shared_memory::error_type::opening_failed);
+}
+
+TEST(shared_memory, resize) {
+  const std::string name = get_test_name("fst_shared_resize");
+  fst::shared_memory sm;
+  EXPECT_EQ(sm.create(name, 64), fst::shared_memory::error_type::none);
+  sm.data()[63] = 7;
+
+  EXPECT_EQ(sm.resize(1 << 20), fst::shared_memory::error_type::none);
+  EXPECT_EQ(sm.size(), 1 << 20);
+  EXPECT_EQ(sm.data()[63], 7);
+  sm.data()[(1 << 20) - 1] = 9;
+
+  fst::shared_memory sm2;
+  EXPECT_EQ(sm2.open(name), fst::shared_memory::error_type::none);
+  EXPECT_EQ(sm2.size(), 1 << 20);
+  EXPECT_EQ(sm2.data()[(1 << 20) - 1], 9);
+
+  EXPECT_EQ(sm.resize(128), fst::shared_memory::error_type::none);
+  EXPECT_EQ(sm2.resize(128), fst::shared_memory::error_type::none);
+  EXPECT_EQ(sm2.data()[63], 7);
+}
+
+TEST(shared_memory, processes) {
+  const std::string name = get_test_name("fst_shared_processes");
+  fst::shared_memory sm;
+  EXPECT_EQ(sm.create(name, 4096), fst::shared_memory::error_type::none);
+
+  const pid_t pid = ::fork();
+  ASSERT_GE(pid, 0);
+
+  if (pid == 0) {
+    fst::shared_memory child;
+    if (child.open(name) != fst::shared_memory::error_type::none) {
+      ::_exit(1);
+    }
+
+    for (std::size_t i = 0; i < child.size(); i++) {
+      child.data()[i] = (std::uint8_t)(i * 3);
+    }
+
+    ::_exit(0);
+  }
+
+  int status = 0;
+  ::waitpid(pid, &status, 0);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  bool all_equal = true;
+  for (std::size_t i = 0; i < sm.size(); i++) {
+    all_equal = all_equal && sm.data()[i] == (std::uint8_t)(i * 3);
+  }
+
+  EXPECT_TRUE(all_equal);
+}
+} // namespace
+#endif // __FST_UNISTD__
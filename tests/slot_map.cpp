@@ -87,4 +87,138 @@ TEST(slot_map, small_vector) {
   EXPECT_TRUE(map.capacity() > 2);
   EXPECT_EQ(map.size(), 3);
 }
+
+TEST(slot_map, soa) {
+  struct position {
+    float x, y;
+  };
+
+  using map_type = fst::soa_slot_map<position, float, std::string>;
+  using key_type = map_type::key_type;
+  map_type map;
+
+  key_type k1 = map.emplace(position{ 1.0f, 1.0f }, 1.0f, "Bingo1");
+  key_type k2 = map.emplace(position{ 2.0f, 2.0f }, 2.0f, "Bingo2");
+  key_type k3 = map.emplace(position{ 3.0f, 3.0f }, 3.0f, "Bingo3");
+  EXPECT_EQ(map.size(), 3);
+
+  auto [pos, speed] = map.columns<0, 1>();
+  EXPECT_EQ(pos.size(), 3);
+  for (std::size_t i = 0; i < pos.size(); i++) {
+    pos[i].x += speed[i];
+  }
+
+  EXPECT_EQ(map.at<0>(k2).x, 4.0f);
+  EXPECT_EQ(map.at<2>(k3), "Bingo3");
+
+  EXPECT_EQ(map.erase(k1), 1);
+  EXPECT_EQ(map.erase(k1), 0);
+  EXPECT_FALSE(map.contains(k1));
+  EXPECT_EQ(map.find<2>(k1), nullptr);
+  EXPECT_EQ(map.size(), 2);
+
+  // The last element was moved in place of the erased one.
+  EXPECT_EQ(map.column<2>()[0], "Bingo3");
+  EXPECT_EQ(map.key_at(0).get_index(), k3.get_index());
+  EXPECT_EQ(*map.find<2>(k2), "Bingo2");
+  EXPECT_EQ(map.at<0>(k3).x, 6.0f);
+
+  // The slot of k1 is reused with a new generation.
+  key_type k4 = map.emplace(position{}, 4.0f, "Bingo4");
+  EXPECT_EQ(k4.get_index(), k1.get_index());
+  EXPECT_NE(k4.get_generation(), k1.get_generation());
+  EXPECT_EQ(map.at<1>(k4), 4.0f);
+  EXPECT_FALSE(map.contains(k1));
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.slot_count(), 0);
+}
+
+TEST(slot_map, emplace_n) {
+  using map_type = fst::slot_map<std::string>;
+  using key_type = map_type::key_type;
+  map_type map;
+  map.insert("Bingo");
+
+  std::vector<key_type> keys;
+  map.emplace_n(16, std::back_inserter(keys), "Banana");
+  EXPECT_EQ(keys.size(), 16);
+  EXPECT_EQ(map.size(), 17);
+
+  for (const key_type& key : keys) {
+    EXPECT_EQ(map.at(key), "Banana");
+  }
+}
+
+TEST(slot_map, erase_keys) {
+  using map_type = fst::slot_map<int>;
+  using key_type = map_type::key_type;
+  map_type map;
+
+  std::vector<key_type> keys;
+  for (int i = 0; i < 100; i++) {
+    keys.push_back(map.insert(i));
+  }
+
+  // Erase every third value, with an expired and a duplicated key.
+  std::vector<key_type> to_erase;
+  for (int i = 0; i < 100; i += 3) {
+    to_erase.push_back(keys[i]);
+  }
+  to_erase.push_back(keys[0]);
+  EXPECT_EQ(map.erase(keys[99]), 1);
+  to_erase.push_back(keys[99]);
+
+  EXPECT_EQ(map.erase_keys(to_erase), 33);
+  EXPECT_EQ(map.size(), 66);
+  EXPECT_EQ(map.erase_keys(to_erase), 0);
+
+  for (int i = 0; i < 99; i++) {
+    if (i % 3 == 0) {
+      EXPECT_TRUE(map.find(keys[i]) == map.end());
+    }
+    else {
+      EXPECT_EQ(map.at(keys[i]), i);
+    }
+  }
+
+  // The freed slots are reused.
+  key_type k = map.insert(1000);
+  EXPECT_LT(k.get_index(), 100);
+  EXPECT_EQ(map.at(k), 1000);
+  EXPECT_EQ(map.size(), 67);
+}
+
+TEST(slot_map, sort) {
+  using map_type = fst::slot_map<int>;
+  using key_type = map_type::key_type;
+  map_type map;
+
+  std::vector<key_type> keys;
+  for (int i = 0; i < 64; i++) {
+    keys.push_back(map.insert((i * 37) % 64));
+  }
+
+  map.erase(keys[5]);
+  map.sort();
+  EXPECT_TRUE(std::is_sorted(map.begin(), map.end()));
+
+  for (int i = 0; i < 64; i++) {
+    if (i == 5) {
+      EXPECT_TRUE(map.find(keys[i]) == map.end());
+    }
+    else {
+      EXPECT_EQ(map.at(keys[i]), (i * 37) % 64);
+    }
+  }
+
+  map.sort(std::greater<>());
+  EXPECT_TRUE(std::is_sorted(map.begin(), map.end(), std::greater<>()));
+  EXPECT_EQ(map.at(keys[0]), 0);
+
+  map.erase(keys[0]);
+  EXPECT_EQ(map.size(), 62);
+  EXPECT_TRUE(std::is_sorted(map.begin(), map.end() - 1, std::greater<>()));
+}
 } // namespace
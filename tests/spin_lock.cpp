@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include "fst/spin_lock.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+TEST(spin_lock, try_lock) {
+  fst::spin_lock_mutex mutex;
+  EXPECT_TRUE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock());
+  mutex.unlock();
+  EXPECT_TRUE(mutex.try_lock());
+  mutex.unlock();
+}
+
+TEST(spin_lock, contention) {
+  constexpr std::size_t thread_count = 8;
+  constexpr std::size_t iterations = 20000;
+
+  fst::spin_lock_mutex mutex;
+  std::size_t counter = 0;
+  std::vector<std::thread> threads;
+
+  for (std::size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&]() {
+      for (std::size_t i = 0; i < iterations; i++) {
+        fst::scoped_spin_lock lock(mutex);
+        counter++;
+
+        // Long enough critical sections for some threads to park.
+        if (i % 1000 == 0) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(counter, thread_count * iterations);
+}
+
+TEST(spin_lock, shared_try_lock) {
+  fst::shared_spin_lock mutex;
+  EXPECT_TRUE(mutex.try_lock_shared());
+  EXPECT_TRUE(mutex.try_lock_shared());
+  EXPECT_FALSE(mutex.try_lock());
+  mutex.unlock_shared();
+  mutex.unlock_shared();
+
+  EXPECT_TRUE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock_shared());
+  mutex.unlock();
+  EXPECT_TRUE(mutex.try_lock_shared());
+  mutex.unlock_shared();
+}
+
+TEST(spin_lock, shared_writer_priority) {
+  fst::shared_spin_lock mutex;
+  std::atomic<bool> writer_done = false;
+
+  mutex.lock_shared();
+  std::thread writer([&]() {
+    fst::scoped_write_lock lock(mutex);
+    writer_done = true;
+  });
+
+  // Once the writer is pending, new readers have to wait for it.
+  while (mutex.try_lock_shared()) {
+    mutex.unlock_shared();
+    std::this_thread::yield();
+  }
+
+  EXPECT_FALSE(writer_done);
+  mutex.unlock_shared();
+  writer.join();
+  EXPECT_TRUE(writer_done);
+}
+
+TEST(spin_lock, shared_contention) {
+  constexpr std::size_t thread_count = 8;
+  constexpr std::size_t iterations = 20000;
+
+  fst::shared_spin_lock mutex;
+  std::size_t a = 0;
+  std::size_t b = 0;
+  std::atomic<std::size_t> mismatch_count = 0;
+  std::vector<std::thread> threads;
+
+  for (std::size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t]() {
+      for (std::size_t i = 0; i < iterations; i++) {
+        if (t % 2 == 0 && i % 4 == 0) {
+          fst::scoped_write_lock lock(mutex);
+          a++;
+          b++;
+        }
+        else {
+          fst::scoped_read_lock lock(mutex);
+          if (a != b) {
+            mismatch_count++;
+          }
+        }
+      }
+    });
+  }
+
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(mismatch_count, 0);
+  EXPECT_EQ(a, thread_count / 2 * iterations / 4);
+  EXPECT_EQ(b, a);
+}
+
+TEST(spin_lock, ticket) {
+  constexpr std::size_t thread_count = 4;
+  constexpr std::size_t iterations = 20000;
+
+  fst::ticket_spin_lock mutex;
+  EXPECT_TRUE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock());
+  mutex.unlock();
+
+  std::size_t counter = 0;
+  std::vector<std::thread> threads;
+
+  for (std::size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&]() {
+      for (std::size_t i = 0; i < iterations; i++) {
+        fst::scoped_ticket_lock lock(mutex);
+        counter++;
+      }
+    });
+  }
+
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(counter, thread_count * iterations);
+}
+} // namespace